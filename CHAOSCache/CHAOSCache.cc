@@ -1,18 +1,34 @@
 #include "mem/cache/CHAOSCache/CHAOSCache.hh"
 
+#include <algorithm>
+#include <cstring>
+#include <iomanip>
 #include <random>
 #include <vector>
 
+#include "base/cprintf.hh"
+#include "base/intmath.hh"
 #include "debug/CHAOSCache.hh"
 #include "mem/cache/base.hh"
 #include "mem/cache/cache_blk.hh"
 #include "mem/cache/tags/base.hh"
+#include "mem/cache/tags/base_set_assoc.hh"
+#include "mem/cache/tags/fa_lru.hh"
+#include "mem/cache/tags/indexing_policies/base.hh"
+#include "mem/cache/replacement_policies/base.hh"
+#include "params/BaseCache.hh"
+#include "sim/system.hh"
+#include "CHAOSCommon/checkpoint.hh"
+#include "CHAOSCommon/mask_kernels.hh"
 
 namespace gem5
 {
+    // Number of random set/way draws before falling back to a full scan of
+    // the tags (only happens while the cache is mostly empty).
+    static constexpr int maxBlockSamplingAttempts = 32;
+
     CHAOSCache::CHAOSCache(const CHAOSCacheParams& p) :
         SimObject(p),
-        targetCache(p.target_cache),
         probability(p.probability),
         bits_to_change(p.bitsToChange),
         corruption_size(p.corruptionSize),
@@ -24,16 +40,135 @@ namespace gem5
         bit_flip_prob(p.bitFlipProb),
         stuck_at_zero_prob(p.stuckAtZeroProb),
         stuck_at_one_prob(p.stuckAtOneProb),
-        cycles_permament_fault_check(p.cyclesPermamentFaultCheck),
         write_log(p.writeLog),
+        binary_log(p.logFormat == "binary"),
+        campaign_mode(p.campaignMode),
+        seed(p.seed),
+        experiment(p.experiment),
+        use_schedule(!p.faultSchedule.empty()),
+        ace_analysis(p.aceAnalysis),
+        mbu_pattern(stringToMBUPattern(p.mbuPattern)),
+        mbu_bits(p.mbuBits),
+        mbu_blocks(p.mbuBlocks),
+        fault_target(stringToFaultTarget(p.faultTarget)),
         attackEvent([this] { this->injectFault(); }, name()),
-        periodicCheck([this] { this->checkPermanent(); }, name() + ".periodicCheck"),
+        restored(false),
+        restored_attack_tick(MaxTick),
         stats(nullptr)
     {
-        if (probability != 0.0) {
-            log_stream = simout.create("cache_injections.log", false, true);
-            if (!log_stream || !log_stream->stream()) {
-                panic("CHAOSCache: Could not open log file");
+        std::vector<Cache*> caches(p.target_caches.begin(), p.target_caches.end());
+        if (caches.empty() && p.target_cache) {
+            caches.push_back(p.target_cache);
+        }
+        if (caches.empty()) {
+            fatal("CHAOSCache: no target cache, set target_cache or target_caches.\n");
+        }
+
+        std::vector<std::string> cache_names;
+        for (auto *cache : caches) {
+            const auto &cache_params = static_cast<const BaseCacheParams&>(cache->params());
+            Target target = {cache, getTags(cache), 0, 0, cache->getBlockSize(),
+                             uint64_t(cache_params.size) * 8};
+            if (dynamic_cast<BaseSetAssoc*>(target.tags)) {
+                target.assoc = cache_params.assoc;
+                target.num_sets = cache_params.size / (target.block_size * target.assoc);
+            }
+
+            if (ace_analysis) {
+                if (target.num_sets == 0) {
+                    fatal("CHAOSCache: aceAnalysis needs set-associative tags (%s).\n", cache->name());
+                }
+                // A single cache keeps its stats under "avf"
+                std::string group = (caches.size() == 1) ? "avf" : csprintf("avf_cache%d", targets.size());
+                target.ace_last_event.assign(size_t(target.num_sets) * target.assoc * target.block_size, 0);
+                target.ace_dirty.assign(size_t(target.num_sets) * target.assoc, false);
+                target.ace_track_misses = cache_params.clusivity != enums::mostly_excl;
+                target.avf_stats = std::make_unique<CHAOSCacheAVFStats>(
+                    this, group, target.num_sets, uint64_t(target.assoc) * target.block_size);
+            }
+
+            if ((mbu_pattern == MBUPattern::ColumnSets || mbu_pattern == MBUPattern::ColumnWays) &&
+                target.num_sets == 0) {
+                fatal("CHAOSCache: mbuPattern=%s needs set-associative tags (%s).\n", p.mbuPattern, cache->name());
+            }
+            line_mask.resize(std::max<size_t>(line_mask.size(), target.block_size));
+
+            // Tags and replacement state are only reached through the
+            // set-associative and fully-associative LRU tags
+            bool falru = dynamic_cast<FALRU*>(target.tags) != nullptr;
+            if ((fault_target == FaultTarget::Tag || fault_target == FaultTarget::Replacement ||
+                 fault_target == FaultTarget::All) && target.num_sets == 0 && !falru) {
+                fatal("CHAOSCache: faultTarget=%s needs set-associative or FALRU tags (%s).\n",
+                      p.faultTarget, cache->name());
+            }
+
+            // The tag holds the address bits above the set index
+            target.tag_shift = floorLog2(target.block_size) + (target.num_sets ? floorLog2(target.num_sets) : 0);
+            if (p.physAddrBits <= int(target.tag_shift) || p.physAddrBits > 64) {
+                fatal("CHAOSCache: physAddrBits=%d leaves no tag bit in %s.\n", p.physAddrBits, cache->name());
+            }
+            target.tag_bits = p.physAddrBits - target.tag_shift;
+
+            if (fault_target == FaultTarget::All) {
+                // Replacement state counted as the log2(ways) bits of an LRU rank
+                uint64_t frames = target.capacity_bits / 8 / target.block_size;
+                int repl_bits = std::max(1, ceilLog2(target.num_sets ? target.assoc : frames));
+                std::vector<double> bits = {double(target.block_size) * 8, double(target.tag_bits),
+                                            4.0, double(repl_bits)};
+                target.field_dist = std::discrete_distribution<int>(bits.begin(), bits.end());
+            }
+
+            cache_names.push_back(cache->name());
+            targets.push_back(std::move(target));
+        }
+
+        if (mbu_bits < 1 || mbu_blocks < 1) {
+            fatal("CHAOSCache: mbuBits and mbuBlocks must be at least 1.\n");
+        }
+
+        // All the caches share one fault stream. Each draw hits one cache,
+        // picked with the weight of its rate (or of its capacity).
+        std::vector<double> weights;
+        if (p.capacityWeighted) {
+            if (!p.cacheProbabilities.empty()) {
+                fatal("CHAOSCache: capacityWeighted and cacheProbabilities are exclusive.\n");
+            }
+            for (const auto &target : targets) {
+                weights.push_back(double(target.capacity_bits));
+            }
+        } else if (!p.cacheProbabilities.empty()) {
+            if (p.cacheProbabilities.size() != targets.size()) {
+                fatal("CHAOSCache: %d cacheProbabilities for %d target caches.\n",
+                      p.cacheProbabilities.size(), targets.size());
+            }
+            weights.assign(p.cacheProbabilities.begin(), p.cacheProbabilities.end());
+        } else {
+            weights.assign(targets.size(), probability);
+        }
+
+        // Per-cache rates: a fault hits at least one cache in a cycle with
+        // probability 1 - prod(1 - p_i). A single cache keeps its rate as is.
+        if (!p.capacityWeighted) {
+            double none = 1.0;
+            for (double rate : weights) {
+                none *= 1.0 - rate;
+            }
+            probability = (targets.size() == 1) ? weights[0] : 1.0 - none;
+        }
+        if (probability != 0.0 && targets.size() > 1) {
+            target_dist = std::discrete_distribution<int>(weights.begin(), weights.end());
+        }
+
+        if (probability != 0.0 || use_schedule || campaign_mode) {
+            if (seed == 0) {
+                seed = (uint64_t(rd()) << 32) | rd();
+            }
+            seedRng();
+
+            // In campaign mode the log is opened by startExperiment(), once
+            // the forked child has its own output directory.
+            if (!campaign_mode || use_schedule) {
+                openLog();
             }
 
             if (bits_to_change == -1){
@@ -41,16 +176,24 @@ namespace gem5
                 bits_to_change = dist(rng);
             }
 
-            stats = std::make_unique<CHAOSCacheStats>(this);
+            stats = std::make_unique<CHAOSCacheStats>(this, cache_names);
 
             first_tick = first_clock * tick_to_clock_ratio;
             last_tick = last_clock * tick_to_clock_ratio;
-            ticks_permament_fault_check = cycles_permament_fault_check * tick_to_clock_ratio;
 
-            rng.seed(rd());
-            inter_fault_cycles_dist = std::geometric_distribution<unsigned>(probability);
+            if (use_schedule) {
+                // Faults come from the schedule file, no sampling takes place
+                fault_schedule.open(p.faultSchedule);
+                if (!fault_schedule.done()) {
+                    scheduleAttack(fault_schedule.peek().when);
+                }
+            } else if (probability != 0.0) {
+                inter_fault_cycles_dist = std::geometric_distribution<unsigned>(probability);
 
-            scheduleAttack(first_tick + inter_fault_cycles_dist(rng) * tick_to_clock_ratio);
+                if (!campaign_mode) {
+                    scheduleAttack(first_tick + inter_fault_cycles_dist(rng) * tick_to_clock_ratio);
+                }
+            }
 
             if ((bit_flip_prob + stuck_at_zero_prob + stuck_at_one_prob) != 1.0){
                 warn("Sum of probabilities is not 1, assuming 0.9 for bitFlipProb, 0.05 for stuckAtZeroProb and 0.05 for stuckAtOneProb.\n");
@@ -61,12 +204,11 @@ namespace gem5
 
             std::vector<double> weights = {bit_flip_prob, stuck_at_zero_prob, stuck_at_one_prob};
             random_fault_distribution = std::discrete_distribution<int>(weights.begin(), weights.end());
-
-            scheduleCheckPermanentFault(first_tick + ticks_permament_fault_check);
         }
     }
 
-    CHAOSCache::CHAOSCacheStats::CHAOSCacheStats(statistics::Group *parent)
+    CHAOSCache::CHAOSCacheStats::CHAOSCacheStats(statistics::Group *parent,
+                                                 const std::vector<std::string> &caches)
     : statistics::Group(parent),
       ADD_STAT(numFaultsInjected, statistics::units::Count::get(),
                "Total number of faults injected"),
@@ -77,8 +219,64 @@ namespace gem5
       ADD_STAT(numStuckAtOne, statistics::units::Count::get(),
                "Number of stuck-at-1 faults injected"),
       ADD_STAT(numPermanentFaults, statistics::units::Count::get(),
-               "Total number of permanent faults injected")
+               "Total number of permanent faults injected"),
+      ADD_STAT(numDataFaults, statistics::units::Count::get(),
+               "Number of faults injected in the data array"),
+      ADD_STAT(numMetadataFaults, statistics::units::Count::get(),
+               "Number of faults injected in the tags, coherence bits and replacement state"),
+      ADD_STAT(numTagFaults, statistics::units::Count::get(),
+               "Number of faults injected in block tags"),
+      ADD_STAT(numCoherenceFaults, statistics::units::Count::get(),
+               "Number of faults injected in the valid, writable, readable and dirty bits"),
+      ADD_STAT(numReplacementFaults, statistics::units::Count::get(),
+               "Number of faults injected in the replacement state"),
+      ADD_STAT(numTagAliases, statistics::units::Count::get(),
+               "Tag faults whose new address was resident in the cache, that block being overwritten"),
+      ADD_STAT(cacheFaultsInjected, statistics::units::Count::get(),
+               "Number of faults injected in each target cache"),
+      ADD_STAT(cacheBitFlips, statistics::units::Count::get(),
+               "Number of bit flip faults injected in each target cache"),
+      ADD_STAT(cacheStuckAtZero, statistics::units::Count::get(),
+               "Number of stuck-at-0 faults injected in each target cache"),
+      ADD_STAT(cacheStuckAtOne, statistics::units::Count::get(),
+               "Number of stuck-at-1 faults injected in each target cache")
+    {
+        for (auto *stat : {&cacheFaultsInjected, &cacheBitFlips, &cacheStuckAtZero, &cacheStuckAtOne}) {
+            stat->init(caches.size());
+            for (size_t i = 0; i < caches.size(); i++) {
+                stat->subname(i, csprintf("cache%d", i));
+                stat->subdesc(i, caches[i]);
+            }
+        }
+    }
+
+    CHAOSCache::CHAOSCacheAVFStats::CHAOSCacheAVFStats(statistics::Group *parent,
+                                                       const std::string &name,
+                                                       uint32_t num_sets, uint64_t set_bytes)
+    : statistics::Group(parent, name.c_str()),
+      ADD_STAT(aceByteTicks, statistics::units::Count::get(),
+               "Byte-ticks spent by data that is later read (ACE)"),
+      ADD_STAT(unAceByteTicks, statistics::units::Count::get(),
+               "Byte-ticks spent by data that is later overwritten or evicted clean (un-ACE)"),
+      ADD_STAT(elapsedTicks, statistics::units::Tick::get(),
+               "Ticks covered by the analysis"),
+      ADD_STAT(setAceByteTicks, statistics::units::Count::get(),
+               "ACE byte-ticks of each set"),
+      ADD_STAT(avf, statistics::units::Ratio::get(),
+               "Architectural vulnerability factor of the cache data array"),
+      ADD_STAT(setAvf, statistics::units::Ratio::get(),
+               "Architectural vulnerability factor of each set")
+    {
+        setAceByteTicks.init(num_sets);
+        avf = aceByteTicks / (elapsedTicks * statistics::constant(double(set_bytes) * num_sets));
+        setAvf = setAceByteTicks / (elapsedTicks * statistics::constant(double(set_bytes)));
+    }
+
+    void
+    CHAOSCache::CHAOSCacheAVFStats::preDumpStats()
     {
+        statistics::Group::preDumpStats();
+        elapsedTicks = curTick();
     }
 
     CHAOSCache::FaultType 
@@ -89,6 +287,46 @@ namespace gem5
         return FaultType::Random;
     }
 
+    CHAOSCache::MBUPattern
+    CHAOSCache::stringToMBUPattern(const std::string &s) {
+        if (s == "adjacent") return MBUPattern::Adjacent;
+        else if (s == "word") return MBUPattern::Word;
+        else if (s == "column_sets") return MBUPattern::ColumnSets;
+        else if (s == "column_ways") return MBUPattern::ColumnWays;
+        return MBUPattern::Bytes;
+    }
+
+    const char *
+    CHAOSCache::mbuPatternName(MBUPattern p) {
+        switch (p) {
+            case MBUPattern::Adjacent: return "adjacent";
+            case MBUPattern::Word: return "word";
+            case MBUPattern::ColumnSets: return "column_sets";
+            case MBUPattern::ColumnWays: return "column_ways";
+            default: return "bytes";
+        }
+    }
+
+    CHAOSCache::FaultTarget
+    CHAOSCache::stringToFaultTarget(const std::string &s) {
+        if (s == "tag") return FaultTarget::Tag;
+        else if (s == "coherence") return FaultTarget::Coherence;
+        else if (s == "replacement") return FaultTarget::Replacement;
+        else if (s == "all") return FaultTarget::All;
+        return FaultTarget::Data;
+    }
+
+    const char *
+    CHAOSCache::faultTargetName(FaultTarget f) {
+        switch (f) {
+            case FaultTarget::Tag: return "tag";
+            case FaultTarget::Coherence: return "coherence";
+            case FaultTarget::Replacement: return "replacement";
+            case FaultTarget::All: return "all";
+            default: return "data";
+        }
+    }
+
     const char* 
     CHAOSCache::faultTypeToString(CHAOSCache::FaultType f) {
         switch (f) {
@@ -99,6 +337,176 @@ namespace gem5
         return "random";
     }
 
+    void
+    CHAOSCache::seedRng()
+    {
+        // Instances sharing the same seed still get independent keys
+        rng.seed(seed ^ chaos::Philox::hashName(name()), experiment);
+        inform("%s: seed %llu, experiment %llu\n", name(), seed, experiment);
+    }
+
+    void
+    CHAOSCache::openLog()
+    {
+        if (binary_log) {
+            std::vector<std::string> strings;
+            for (const auto &target : targets) {
+                strings.push_back(target.cache->name());
+            }
+            bin_log.open(simout.resolve("cache_injections.bin"), strings, targets.size());
+            return;
+        }
+
+        log_stream = simout.create("cache_injections.log", false, true);
+        if (!log_stream || !log_stream->stream()) {
+            panic("CHAOSCache: Could not open log file");
+        }
+    }
+
+    void
+    CHAOSCache::startExperiment(uint64_t experiment)
+    {
+        if (probability <= 0.0 || !campaign_mode || use_schedule)
+            return;
+
+        openLog();
+
+        this->experiment = experiment;
+        seedRng();
+
+        scheduleAttack(std::max(curTick(), first_tick) + inter_fault_cycles_dist(rng) * tick_to_clock_ratio);
+    }
+
+    void
+    CHAOSCache::startup()
+    {
+        SimObject::startup();
+
+        if (!restored)
+            return;
+
+        // The event scheduled by the constructor assumed a start at tick 0
+        chaos::restoreEvent(*this, attackEvent, restored_attack_tick);
+
+        // An experiment started before the checkpoint logs to this run
+        if (campaign_mode && !use_schedule && restored_attack_tick != MaxTick) {
+            openLog();
+        }
+    }
+
+    bool
+    CHAOSCache::isInjecting() const
+    {
+        return probability != 0.0 || use_schedule || campaign_mode;
+    }
+
+    void
+    CHAOSCache::serialize(CheckpointOut &cp) const
+    {
+        bool injecting = isInjecting();
+        SERIALIZE_SCALAR(injecting);
+        if (!injecting)
+            return;
+
+        SERIALIZE_SCALAR(seed);
+        SERIALIZE_SCALAR(experiment);
+        SERIALIZE_SCALAR(bits_to_change);
+        chaos::serializeRng(cp, rng);
+        chaos::serializeEventTick(cp, "attackTick", attackEvent);
+        if (use_schedule) {
+            paramOut(cp, "schedulePosition", fault_schedule.position());
+        }
+
+        // The cache contents are written back before a checkpoint, the
+        // stuck bytes are applied again when their blocks are refilled
+        std::vector<int> fault_caches;
+        std::vector<Addr> fault_blocks;
+        std::vector<int> fault_offsets;
+        std::vector<int> fault_types;
+        std::vector<uint64_t> fault_masks;
+        for (size_t i = 0; i < targets.size(); i++) {
+            for (const auto &entry : targets[i].permanent_faults) {
+                fault_caches.push_back(i);
+                fault_blocks.push_back(entry.first.first);
+                fault_offsets.push_back(entry.first.second);
+                fault_types.push_back(int(entry.second.fault_type));
+                fault_masks.push_back(entry.second.mask);
+            }
+        }
+        SERIALIZE_CONTAINER(fault_caches);
+        SERIALIZE_CONTAINER(fault_blocks);
+        SERIALIZE_CONTAINER(fault_offsets);
+        SERIALIZE_CONTAINER(fault_types);
+        SERIALIZE_CONTAINER(fault_masks);
+    }
+
+    void
+    CHAOSCache::unserialize(CheckpointIn &cp)
+    {
+        bool injecting;
+        UNSERIALIZE_SCALAR(injecting);
+        if (!injecting || !isInjecting()) {
+            if (injecting != isInjecting()) {
+                warn("CHAOSCache: injection enabled in only one of the checkpoint and the configuration, injector state not restored.\n");
+            }
+            return;
+        }
+
+        UNSERIALIZE_SCALAR(seed);
+        UNSERIALIZE_SCALAR(experiment);
+        UNSERIALIZE_SCALAR(bits_to_change);
+        chaos::unserializeRng(cp, rng);
+        restored_attack_tick = chaos::unserializeEventTick(cp, "attackTick");
+        if (use_schedule) {
+            uint64_t position;
+            paramIn(cp, "schedulePosition", position);
+            fault_schedule.setPosition(position);
+        }
+
+        std::vector<int> fault_caches;
+        std::vector<Addr> fault_blocks;
+        std::vector<int> fault_offsets;
+        std::vector<int> fault_types;
+        std::vector<uint64_t> fault_masks;
+        UNSERIALIZE_CONTAINER(fault_caches);
+        UNSERIALIZE_CONTAINER(fault_blocks);
+        UNSERIALIZE_CONTAINER(fault_offsets);
+        UNSERIALIZE_CONTAINER(fault_types);
+        UNSERIALIZE_CONTAINER(fault_masks);
+        for (auto &target : targets) {
+            target.permanent_faults.clear();
+        }
+        for (size_t i = 0; i < fault_blocks.size(); i++) {
+            if (fault_caches[i] >= int(targets.size())) {
+                fatal("CHAOSCache: the checkpoint holds a fault on cache %d, %d target caches are configured.\n",
+                      fault_caches[i], targets.size());
+            }
+            targets[fault_caches[i]].permanent_faults[std::make_pair(fault_blocks[i], fault_offsets[i])] =
+                {static_cast<FaultType>(fault_types[i]), fault_masks[i]};
+        }
+
+        restored = true;
+    }
+
+    void
+    CHAOSCache::armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                         uint32_t fault_type, uint64_t mask)
+    {
+        if (!campaign_mode || fault_schedule.isOpen()) {
+            warn("CHAOSCache: armFault() needs campaignMode and no faultSchedule, fault ignored.\n");
+            return;
+        }
+
+        // The first armed fault turns the injector into an in-memory schedule
+        if (!use_schedule) {
+            openLog();
+            use_schedule = true;
+        }
+
+        fault_schedule.append({when, target, target2, uint16_t(target3), uint8_t(fault_type), 0, mask});
+        scheduleAttack(std::max(Tick(fault_schedule.peek().when), curTick()));
+    }
+
     void 
     CHAOSCache::scheduleAttack(Tick time) {
         if (!attackEvent.scheduled()) {
@@ -106,25 +514,86 @@ namespace gem5
         }
     }
 
-    void 
-    CHAOSCache::scheduleCheckPermanentFault(Tick time) {
-        if (!periodicCheck.scheduled()) {
-            schedule(periodicCheck, time);
+    void
+    CHAOSCache::regProbeListeners()
+    {
+        // Stuck-at bits are re-applied every time the block data is filled or
+        // written, which is the only time they can be overwritten.
+        // A schedule, or faults armed by a campaign driver, may hold
+        // stuck-at records whatever faultType says.
+        bool enforce_stuck_at = use_schedule || campaign_mode ||
+                                (probability != 0.0 && fault_type_enum != FaultType::BitFlip);
+
+        // The probes do not say which cache they belong to, each listener
+        // carries the index of its target
+        for (int i = 0; i < int(targets.size()); i++) {
+            ProbeManager *manager = targets[i].cache->getProbeManager();
+
+            if (ace_analysis) {
+                listeners.push_back(std::make_unique<ProbeListenerArgFunc<CacheAccessProbeArg>>(
+                    manager, "Hit", [this, i](const CacheAccessProbeArg &arg) { notifyAceAccess(i, arg); }));
+                listeners.push_back(std::make_unique<ProbeListenerArgFunc<CacheAccessProbeArg>>(
+                    manager, "Miss", [this, i](const CacheAccessProbeArg &arg) { notifyAceMiss(i, arg); }));
+                listeners.push_back(std::make_unique<ProbeListenerArgFunc<CacheDataUpdateProbeArg>>(
+                    manager, "Data Update", [this, i](const CacheDataUpdateProbeArg &arg) { notifyAceDataUpdate(i, arg); }));
+            }
+
+            if (enforce_stuck_at) {
+                listeners.push_back(std::make_unique<ProbeListenerArgFunc<CacheDataUpdateProbeArg>>(
+                    manager, "Data Update", [this, i](const CacheDataUpdateProbeArg &arg) { notifyDataUpdate(i, arg); }));
+            }
         }
     }
 
     BaseTags*
-    CHAOSCache::getTags() const
+    CHAOSCache::getTags(Cache *cache)
     {
         struct CacheAccessor : public Cache {
             BaseTags* getTagsPublic() { return tags; }
         };
         
-        return static_cast<CacheAccessor*>(targetCache)->getTagsPublic();
+        return static_cast<CacheAccessor*>(cache)->getTagsPublic();
+    }
+
+    CacheBlk*
+    CHAOSCache::pickRandomValidBlock(int target)
+    {
+        BaseTags *tags = targets[target].tags;
+        uint32_t num_sets = targets[target].num_sets;
+        uint32_t assoc = targets[target].assoc;
+
+        // Rejection sampling over set/way: uniform over the valid blocks and
+        // independent of the cache size once the cache is warm.
+        if (num_sets > 0) {
+            std::uniform_int_distribution<uint32_t> setDist(0, num_sets - 1);
+            std::uniform_int_distribution<uint32_t> wayDist(0, assoc - 1);
+
+            for (int attempt = 0; attempt < maxBlockSamplingAttempts; attempt++) {
+                CacheBlk* blk = static_cast<CacheBlk*>(tags->findBlockBySetAndWay(setDist(rng), wayDist(rng)));
+                if (blk && blk->isValid()) {
+                    return blk;
+                }
+            }
+        }
+
+        std::vector<CacheBlk*> validBlocks;
+
+        tags->forEachBlk([&validBlocks](CacheBlk &blk) {
+            if (blk.isValid()) {
+                validBlocks.push_back(&blk);
+            }
+        });
+
+        if (validBlocks.empty()) {
+            return nullptr;
+        }
+
+        std::uniform_int_distribution<int> blockDist(0, validBlocks.size() - 1);
+        return validBlocks[blockDist(rng)];
     }
 
     uint8_t 
-    CHAOSCache::generateRandomMask(std::mt19937 &rng, int bits_to_change, unsigned size) {
+    CHAOSCache::generateRandomMask(chaos::Philox &rng, int bits_to_change, unsigned size) {
         uint8_t mask = 0;
         std::uniform_int_distribution<int> bit_dist(0, size - 1);
         for (int i = 0; i < bits_to_change; i++) {
@@ -136,29 +605,24 @@ namespace gem5
     void
     CHAOSCache::injectFault()
     {   
-        BaseTags* tags = getTags();
-        unsigned blockSize = targetCache->getBlockSize();
-        
-        std::vector<CacheBlk*> validBlocks;
-        
-        tags->forEachBlk([&validBlocks](CacheBlk &blk) {
-            if (blk.isValid()) {
-                validBlocks.push_back(&blk);
-            }
-        });
+        if (use_schedule) {
+            injectScheduled();
+            return;
+        }
+
+        // With a single cache no number is drawn, its stream is unchanged
+        int target = (targets.size() == 1) ? 0 : target_dist(rng);
+        BaseTags* tags = targets[target].tags;
+        unsigned blockSize = targets[target].block_size;
         
-        if (validBlocks.empty()) {
+        CacheBlk* targetBlk = pickRandomValidBlock(target);
+
+        if (!targetBlk) {
             warn("No valid block found\n");
         } else{
-        
-            std::uniform_int_distribution<int> blockDist(0, validBlocks.size() - 1);
-            int randomIdx = blockDist(rng);
-            CacheBlk* targetBlk = validBlocks[randomIdx];
 
             Addr blockAddr = tags->regenerateBlkAddr(targetBlk);
 
-            uint8_t* data = targetBlk->data;
-
             std::uniform_int_distribution<int> byteDist(0, blockSize - 1);
 
             FaultType chosen_fault_type_enum = fault_type_enum;
@@ -166,53 +630,32 @@ namespace gem5
                 int faultIdx = random_fault_distribution(rng);
                 chosen_fault_type_enum = static_cast<FaultType>(faultIdx);
             }
-            
-            for (int i = 0; i < corruption_size; i++) {
-                unsigned char mask = (fault_mask != 0) ? fault_mask : generateRandomMask(rng, bits_to_change, 8);
-                int byteOffset = byteDist(rng);
 
-                if (mask == 0) {
-                    warn("Mask is 0.");
-                    continue;
-                }
+            // With the default faultTarget no number is drawn
+            FaultTarget field = fault_target;
+            if (field == FaultTarget::All) {
+                field = static_cast<FaultTarget>(targets[target].field_dist(rng));
+            }
 
-                // uint8_t oldValue = data[byteOffset];
-
-                switch (chosen_fault_type_enum) {
-                    case FaultType::StuckAtZero:
-                        data[byteOffset] &= ~mask;
-                        stats->numStuckAtZero++;
-                        stats->numPermanentFaults++;
-                        permanent_faults[std::make_pair(blockAddr, byteOffset)] = {chosen_fault_type_enum, mask, true};
-                        break;
-                    case FaultType::StuckAtOne:
-                        data[byteOffset] |= mask;
-                        stats->numStuckAtOne++;
-                        stats->numPermanentFaults++;
-                        permanent_faults[std::make_pair(blockAddr, byteOffset)] = {chosen_fault_type_enum, mask, true};
-                        break;
-                    case FaultType::BitFlip:
-                        data[byteOffset] ^= mask;
-                        stats->numBitFlips++;
-                        break;
-                    default:
-                        break;
-                }
+            if (field != FaultTarget::Data) {
+                corruptMetadata(target, targetBlk, field, chosen_fault_type_enum);
+            } else if (mbu_pattern != MBUPattern::Bytes) {
+                injectPattern(target, targetBlk, chosen_fault_type_enum);
+            } else {
+                for (int i = 0; i < corruption_size; i++) {
+                    unsigned char mask = (fault_mask != 0) ? fault_mask : generateRandomMask(rng, bits_to_change, 8);
+                    int byteOffset = byteDist(rng);
 
-                // uint8_t newValue = data[byteOffset];
-                stats->numFaultsInjected++;
+                    if (mask == 0) {
+                        warn("Mask is 0.");
+                        continue;
+                    }
 
-                if (write_log){
-                    *(log_stream->stream())  << "Tick: " << curTick()
-                        << ", Cache Block Addr: " << blockAddr
-                        << ", Byte Offset: " << byteOffset
-                        << ", FaultType: " << faultTypeToString(chosen_fault_type_enum)
-                        << ", Mask: " << std::bitset<8>(mask)
-                        << std::endl;
+                    corruptByte(target, targetBlk, blockAddr, byteOffset, chosen_fault_type_enum, mask);
                 }
-            }
 
-            targetBlk->setCoherenceBits(CacheBlk::DirtyBit);
+                targetBlk->setCoherenceBits(CacheBlk::DirtyBit);
+            }
         }
 
         Tick next_injection = curTick() + inter_fault_cycles_dist(rng) * tick_to_clock_ratio;
@@ -222,45 +665,595 @@ namespace gem5
     }
 
     void
-    CHAOSCache::checkPermanent()
+    CHAOSCache::corruptByte(int target, CacheBlk *blk, Addr blockAddr, int byteOffset,
+                            FaultType fault_type, uint8_t mask)
     {
-        BaseTags* tags = getTags();
-
-        for (auto& entry : permanent_faults) {
-            if(entry.second.update){
-                const std::pair<Addr, int>& key = entry.first;
-                const PermanentFault& fault = entry.second;
-
-                Addr blockAddr = key.first;
-                int byteOffset = key.second;
-                FaultType faultType = fault.fault_type;
-                uint64_t mask = fault.mask;
-
-                CacheBlk* blk = nullptr;
-                tags->forEachBlk([&](CacheBlk &b) {
-                    Addr blkAddr = tags->regenerateBlkAddr(&b);
-                    if (blkAddr == blockAddr && b.isValid()) {
-                        blk = &b;
-                    }
-                });
-                if (!blk) {
-                    continue;
+        uint8_t* data = blk->data;
+        auto &permanent_faults = targets[target].permanent_faults;
+
+        chaos::notifyBeforeCorruption(blockAddr + byteOffset, 1);
+
+        switch (fault_type) {
+            case FaultType::StuckAtZero:
+                data[byteOffset] &= ~mask;
+                stats->numStuckAtZero++;
+                stats->cacheStuckAtZero[target]++;
+                stats->numPermanentFaults++;
+                permanent_faults[std::make_pair(blockAddr, byteOffset)] = {fault_type, mask};
+                break;
+            case FaultType::StuckAtOne:
+                data[byteOffset] |= mask;
+                stats->numStuckAtOne++;
+                stats->cacheStuckAtOne[target]++;
+                stats->numPermanentFaults++;
+                permanent_faults[std::make_pair(blockAddr, byteOffset)] = {fault_type, mask};
+                break;
+            case FaultType::BitFlip:
+                data[byteOffset] ^= mask;
+                stats->numBitFlips++;
+                stats->cacheBitFlips[target]++;
+                break;
+            default:
+                break;
+        }
+
+        stats->numFaultsInjected++;
+        stats->numDataFaults++;
+        stats->cacheFaultsInjected[target]++;
+        chaos::notifyFaultInjected(fault_type != FaultType::BitFlip);
+
+        if (write_log && binary_log) {
+            bin_log.append({curTick(), blockAddr, mask, uint32_t(byteOffset), uint16_t(target),
+                            chaos::LogKind::Cache, uint8_t(fault_type)});
+        } else if (write_log){
+            // The cache is only named when there is more than one
+            *(log_stream->stream())  << "Tick: " << curTick();
+            if (targets.size() > 1) {
+                *(log_stream->stream()) << ", Cache: " << targets[target].cache->name();
+            }
+            *(log_stream->stream())
+                << ", Cache Block Addr: " << blockAddr
+                << ", Byte Offset: " << byteOffset
+                << ", FaultType: " << faultTypeToString(fault_type)
+                << ", Mask: " << std::bitset<8>(mask)
+                << std::endl;
+        }
+    }
+
+    void
+    CHAOSCache::buildLineMask(unsigned block_size)
+    {
+        std::fill(line_mask.begin(), line_mask.begin() + block_size, 0);
+        unsigned line_bits = block_size * 8;
+        unsigned bits = std::min<unsigned>(mbu_bits, line_bits);
+
+        if (mbu_pattern == MBUPattern::Word) {
+            // Distinct bits of one aligned word (all of it with 64 bits)
+            unsigned word_bits = std::min(64u, line_bits);
+            bits = std::min(bits, word_bits);
+            unsigned word = std::uniform_int_distribution<unsigned>(0, line_bits / word_bits - 1)(rng);
+            std::uniform_int_distribution<unsigned> bit_dist(0, word_bits - 1);
+            for (unsigned set = 0; set < bits;) {
+                unsigned bit = word * word_bits + bit_dist(rng);
+                if (!(line_mask[bit / 8] & (1 << (bit % 8)))) {
+                    line_mask[bit / 8] |= 1 << (bit % 8);
+                    set++;
+                }
+            }
+            return;
+        }
+
+        // A run of adjacent bits, which may straddle bytes and words
+        unsigned first = std::uniform_int_distribution<unsigned>(0, line_bits - bits)(rng);
+        for (unsigned bit = first; bit < first + bits; bit++) {
+            line_mask[bit / 8] |= 1 << (bit % 8);
+        }
+    }
+
+    bool
+    CHAOSCache::corruptLine(int target, CacheBlk *blk, FaultType fault_type)
+    {
+        if (!blk || !blk->isValid())
+            return false;
+
+        Target &t = targets[target];
+        Addr blockAddr = t.tags->regenerateBlkAddr(blk);
+        chaos::notifyBeforeCorruption(blockAddr, t.block_size);
+
+        switch (fault_type) {
+            case FaultType::StuckAtZero:
+                chaos::applyMask(blk->data, line_mask.data(), t.block_size, chaos::MaskOp::Clear);
+                break;
+            case FaultType::StuckAtOne:
+                chaos::applyMask(blk->data, line_mask.data(), t.block_size, chaos::MaskOp::Set);
+                break;
+            default:
+                chaos::applyMask(blk->data, line_mask.data(), t.block_size, chaos::MaskOp::Xor);
+                break;
+        }
+
+        if (fault_type == FaultType::StuckAtZero || fault_type == FaultType::StuckAtOne) {
+            for (unsigned i = 0; i < t.block_size; i++) {
+                if (line_mask[i]) {
+                    t.permanent_faults[std::make_pair(blockAddr, int(i))] = {fault_type, line_mask[i]};
+                }
+            }
+        }
+
+        blk->setCoherenceBits(CacheBlk::DirtyBit);
+        return true;
+    }
+
+    void
+    CHAOSCache::injectPattern(int target, CacheBlk *blk, FaultType fault_type)
+    {
+        Target &t = targets[target];
+        buildLineMask(t.block_size);
+        Addr blockAddr = t.tags->regenerateBlkAddr(blk);
+
+        // Column patterns repeat the mask in the next sets (same way) or the
+        // next ways (same set), up to the edge of the cache; invalid frames
+        // hold no data and are skipped
+        int blocks = 0;
+        if (mbu_pattern == MBUPattern::ColumnSets) {
+            for (uint32_t set = blk->getSet(); set < t.num_sets && set < blk->getSet() + mbu_blocks; set++) {
+                blocks += corruptLine(target, static_cast<CacheBlk*>(
+                    t.tags->findBlockBySetAndWay(set, blk->getWay())), fault_type);
+            }
+        } else if (mbu_pattern == MBUPattern::ColumnWays) {
+            for (uint32_t way = blk->getWay(); way < t.assoc && way < blk->getWay() + mbu_blocks; way++) {
+                blocks += corruptLine(target, static_cast<CacheBlk*>(
+                    t.tags->findBlockBySetAndWay(blk->getSet(), way)), fault_type);
+            }
+        } else {
+            blocks = corruptLine(target, blk, fault_type);
+        }
+
+        // One fault per event, whatever the number of bits and blocks
+        countFault(target, fault_type);
+        stats->numDataFaults++;
+        if (fault_type != FaultType::BitFlip) {
+            stats->numPermanentFaults++;
+        }
+        chaos::notifyFaultInjected(fault_type != FaultType::BitFlip);
+
+        if (write_log && binary_log) {
+            // The line mask continues in MemMask records
+            for (unsigned i = 0; i < t.block_size; i += sizeof(uint64_t)) {
+                uint64_t chunk = 0;
+                std::memcpy(&chunk, line_mask.data() + i, std::min<size_t>(sizeof(chunk), t.block_size - i));
+                if (i == 0) {
+                    bin_log.append({curTick(), blockAddr, chunk,
+                                    (uint32_t(mbu_pattern) << 16) | uint32_t(blocks), uint16_t(target),
+                                    chaos::LogKind::CacheLine, uint8_t(fault_type)});
+                } else {
+                    bin_log.append({curTick(), 0, chunk, 0, 0, chaos::LogKind::MemMask, uint8_t(fault_type)});
                 }
+            }
+        } else if (write_log) {
+            std::ostream &os = *(log_stream->stream());
+            os << "Tick: " << curTick();
+            if (targets.size() > 1) {
+                os << ", Cache: " << t.cache->name();
+            }
+            os << ", Cache Block Addr: " << blockAddr
+                << ", Pattern: " << mbuPatternName(mbu_pattern)
+                << ", Blocks: " << blocks
+                << ", FaultType: " << faultTypeToString(fault_type)
+                << ", Mask: " << std::hex;
+            for (unsigned i = 0; i < t.block_size; i++) {
+                os << std::setw(2) << std::setfill('0') << unsigned(line_mask[i]);
+            }
+            os << std::dec << std::endl;
+        }
+    }
+
+    void
+    CHAOSCache::countFault(int target, FaultType fault_type)
+    {
+        switch (fault_type) {
+            case FaultType::StuckAtZero:
+                stats->numStuckAtZero++;
+                stats->cacheStuckAtZero[target]++;
+                break;
+            case FaultType::StuckAtOne:
+                stats->numStuckAtOne++;
+                stats->cacheStuckAtOne[target]++;
+                break;
+            case FaultType::BitFlip:
+                stats->numBitFlips++;
+                stats->cacheBitFlips[target]++;
+                break;
+            default:
+                break;
+        }
+
+        stats->numFaultsInjected++;
+        stats->cacheFaultsInjected[target]++;
+    }
+
+    namespace
+    {
+
+    // The eviction path, the MSHRs, the FALRU list and the replacement
+    // policy are protected
+    struct CacheInvalidator : public Cache {
+        void invalidateBlockPublic(CacheBlk *blk) { invalidateBlock(blk); }
+        bool inFlight(Addr addr, bool is_secure) { return mshrQueue.findMatch(addr, is_secure) != nullptr; }
+        System *systemPublic() { return system; }
+
+        // As a replacement: written back if dirty, a clean eviction
+        // otherwise, so the snoop filters see the block leave the cache
+        void
+        evictBlockPublic(CacheBlk *blk)
+        {
+            PacketList writebacks;
+            BaseCache::evictBlock(blk, writebacks);
+            if (system->isTimingMode()) {
+                doWritebacks(writebacks, clockEdge(forwardLatency));
+            } else {
+                doWritebacksAtomic(writebacks);
+            }
+        }
+    };
+
+    struct SetAssocAccessor : public BaseSetAssoc {
+        replacement_policy::Base* getReplacementPolicy() { return replacementPolicy; }
+    };
+
+    struct FALRUAccessor : public FALRU {
+        void promote(FALRUBlk *blk) { moveToHead(blk); }
+        void demote(FALRUBlk *blk) { moveToTail(blk); }
+    };
+
+    } // anonymous namespace
+
+    bool
+    CHAOSCache::retag(int target, CacheBlk *blk, Addr old_addr, Addr new_addr)
+    {
+        Target &t = targets[target];
+        auto *cache = static_cast<CacheInvalidator*>(t.cache);
+        bool is_secure = blk->isSecure();
+
+        // A block with a request in flight (an upgrade) cannot leave the
+        // cache, no more than for a replacement: the fault is masked
+        if (cache->inFlight(old_addr, is_secure))
+            return false;
+
+        // Rewriting the tag in place would hide the move from the snoop
+        // filters and from the other copies of new_addr. The block leaves
+        // the cache at old_addr as in a replacement, and its data is
+        // written to new_addr in every cache holding it and in memory, as
+        // if the block had been written back under the faulty tag.
+        std::vector<uint8_t> data(blk->data, blk->data + t.block_size);
+        cache->evictBlockPublic(blk);
+
+        if (t.tags->findBlock(new_addr, is_secure)) {
+            stats->numTagAliases++;
+        }
+        System *system = cache->systemPublic();
+        if (system->isMemAddr(new_addr)) {
+            system->physProxy.writeBlob(new_addr, data.data(), t.block_size);
+        }
+
+        // Stuck cells follow the data to new_addr
+        auto &permanent_faults = t.permanent_faults;
+        std::vector<std::pair<int, PermanentFault>> frame_faults;
+        auto it = permanent_faults.lower_bound(std::make_pair(old_addr, 0));
+        while (it != permanent_faults.end() && it->first.first == old_addr) {
+            frame_faults.emplace_back(it->first.second, it->second);
+            it = permanent_faults.erase(it);
+        }
+        for (const auto &fault : frame_faults) {
+            permanent_faults[std::make_pair(new_addr, fault.first)] = fault.second;
+        }
+        return true;
+    }
 
-                uint8_t* data = blk->data;
-                // uint8_t oldValue = data[byteOffset];
-
-                switch (faultType) {
-                    case FaultType::StuckAtZero:
-                        data[byteOffset] &= ~((uint8_t)mask);
-                        break;
-                    case FaultType::StuckAtOne:
-                        data[byteOffset] |= ((uint8_t)mask);
-                        break;
-                    default:
-                        break;
+    void
+    CHAOSCache::corruptMetadata(int target, CacheBlk *blk, FaultTarget field, FaultType fault_type)
+    {
+        Target &t = targets[target];
+        Addr blockAddr = t.tags->regenerateBlkAddr(blk);
+        uint64_t mask = 0;
+
+        switch (field) {
+            case FaultTarget::Tag: {
+                // The mask is in address bit positions
+                std::uniform_int_distribution<unsigned> bit_dist(0, t.tag_bits - 1);
+                for (int i = 0; i < bits_to_change; i++) {
+                    mask |= uint64_t(1) << (bit_dist(rng) + t.tag_shift);
+                }
+                Addr newAddr = blockAddr;
+                if (fault_type == FaultType::StuckAtZero) newAddr &= ~mask;
+                else if (fault_type == FaultType::StuckAtOne) newAddr |= mask;
+                else newAddr ^= mask;
+
+                if (newAddr != blockAddr) {
+                    chaos::notifyBeforeCorruption(blockAddr, t.block_size);
+                    chaos::notifyBeforeCorruption(newAddr, t.block_size);
+                    retag(target, blk, blockAddr, newAddr);
+                }
+                stats->numTagFaults++;
+                break;
+            }
+            case FaultTarget::Coherence: {
+                // State bits as (dirty, readable, writable, valid), the
+                // CacheBlk coherence bits with the valid bit in bit 0
+                mask = (fault_mask & 0xf) ? (fault_mask & 0xf) : generateRandomMask(rng, bits_to_change, 4);
+                unsigned state = 1;
+                for (unsigned bit : {CacheBlk::WritableBit, CacheBlk::ReadableBit, CacheBlk::DirtyBit}) {
+                    if (blk->isSet(bit))
+                        state |= bit;
+                }
+                unsigned new_state = state;
+                if (fault_type == FaultType::StuckAtZero) new_state &= ~mask;
+                else if (fault_type == FaultType::StuckAtOne) new_state |= mask;
+                else new_state ^= mask;
+
+
+                // Permissions are granted by the rest of the hierarchy: a
+                // fault cannot make the block writable or readable, and
+                // only a writable block, held by no other cache, can become
+                // dirty. A block with a request in flight keeps its state.
+                unsigned settable = blk->isSet(CacheBlk::WritableBit) ? CacheBlk::DirtyBit : 0;
+                new_state &= state | settable;
+                if (static_cast<CacheInvalidator*>(t.cache)->inFlight(blockAddr, blk->isSecure())) {
+                    new_state = state;
+                }
+
+                if (new_state != state) {
+                    chaos::notifyBeforeCorruption(blockAddr, t.block_size);
+                }
+                if (!(new_state & 1)) {
+                    // A cleared valid bit drops the block, dirty or not. The
+                    // snoop filters still count the cache as a holder, which
+                    // only costs them a snoop that misses.
+                    static_cast<CacheInvalidator*>(t.cache)->invalidateBlockPublic(blk);
+                } else {
+                    blk->clearCoherenceBits(CacheBlk::AllBits & ~new_state);
+                    blk->setCoherenceBits(CacheBlk::AllBits & new_state);
+                }
+                stats->numCoherenceFaults++;
+                break;
+            }
+            case FaultTarget::Replacement: {
+                // The block becomes the most recently used (mask 1) or the
+                // next victim of its set (mask 0). Replacement state is not
+                // architectural, the fault only changes later evictions.
+                if (fault_type == FaultType::BitFlip) {
+                    mask = std::uniform_int_distribution<int>(0, 1)(rng);
+                } else {
+                    mask = (fault_type == FaultType::StuckAtOne);
+                }
+                if (auto *falru = dynamic_cast<FALRU*>(t.tags)) {
+                    auto *accessor = static_cast<FALRUAccessor*>(falru);
+                    if (mask) accessor->promote(static_cast<FALRUBlk*>(blk));
+                    else accessor->demote(static_cast<FALRUBlk*>(blk));
+                } else {
+                    auto *policy = static_cast<SetAssocAccessor*>(t.tags)->getReplacementPolicy();
+                    if (mask) policy->touch(blk->replacementData);
+                    else policy->invalidate(blk->replacementData);
+                }
+                stats->numReplacementFaults++;
+                break;
+            }
+            default:
+                break;
+        }
+
+        // Metadata stuck-at faults are applied once, they are not enforced
+        countFault(target, fault_type);
+        stats->numMetadataFaults++;
+        chaos::notifyFaultInjected(false);
+
+        if (write_log && binary_log) {
+            bin_log.append({curTick(), blockAddr, mask, uint32_t(field), uint16_t(target),
+                            chaos::LogKind::CacheMeta, uint8_t(fault_type)});
+        } else if (write_log) {
+            std::ostream &os = *(log_stream->stream());
+            os << "Tick: " << curTick();
+            if (targets.size() > 1) {
+                os << ", Cache: " << t.cache->name();
+            }
+            os << ", Cache Block Addr: " << blockAddr
+                << ", Field: " << faultTargetName(field)
+                << ", FaultType: " << faultTypeToString(fault_type)
+                << ", Mask: " << std::hex << "0x" << mask << std::dec << std::endl;
+        }
+    }
+
+    void
+    CHAOSCache::injectScheduled()
+    {
+        while (!fault_schedule.done() && fault_schedule.peek().when <= curTick()) {
+            const chaos::FaultRecord &record = fault_schedule.next();
+
+            // target2 is the way, with the index of the cache in the upper 16 bits
+            uint32_t cache = record.target2 >> 16;
+            uint32_t way = record.target2 & 0xffff;
+            if (cache >= targets.size() || targets[cache].num_sets == 0 ||
+                record.target >= targets[cache].num_sets || way >= targets[cache].assoc ||
+                record.target3 >= targets[cache].block_size ||
+                record.fault_type > uint8_t(FaultType::StuckAtOne)) {
+                warn("CHAOSCache: skipping invalid scheduled fault (cache %d, set %llu, way %d, byte %d)\n",
+                     cache, record.target, way, record.target3);
+                continue;
+            }
+
+            BaseTags* tags = targets[cache].tags;
+            CacheBlk* blk = static_cast<CacheBlk*>(tags->findBlockBySetAndWay(record.target, way));
+            if (!blk || !blk->isValid()) {
+                warn("CHAOSCache: scheduled fault on invalid block (cache %d, set %llu, way %d) dropped\n",
+                     cache, record.target, way);
+                continue;
+            }
+
+            Addr blockAddr = tags->regenerateBlkAddr(blk);
+            corruptByte(cache, blk, blockAddr, record.target3,
+                        static_cast<FaultType>(record.fault_type), uint8_t(record.mask));
+            blk->setCoherenceBits(CacheBlk::DirtyBit);
+        }
+
+        if (!fault_schedule.done()) {
+            scheduleAttack(fault_schedule.peek().when);
+        }
+    }
+
+    void
+    CHAOSCache::applyPermanentFaults(int target, CacheBlk *blk, Addr blockAddr)
+    {
+        const auto &permanent_faults = targets[target].permanent_faults;
+        auto it = permanent_faults.lower_bound(std::make_pair(blockAddr, 0));
+
+        for (; it != permanent_faults.end() && it->first.first == blockAddr; ++it) {
+            int byteOffset = it->first.second;
+            uint8_t mask = it->second.mask;
+
+            switch (it->second.fault_type) {
+                case FaultType::StuckAtZero:
+                    blk->data[byteOffset] &= ~mask;
+                    break;
+                case FaultType::StuckAtOne:
+                    blk->data[byteOffset] |= mask;
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+
+    void
+    CHAOSCache::notifyDataUpdate(int target, const CacheDataUpdateProbeArg &arg)
+    {
+        const auto &permanent_faults = targets[target].permanent_faults;
+
+        // Invalidations carry no new data, there is nothing to enforce.
+        if (permanent_faults.empty() || arg.newData.empty())
+            return;
+
+        auto it = permanent_faults.lower_bound(std::make_pair(arg.addr, 0));
+        if (it == permanent_faults.end() || it->first.first != arg.addr)
+            return;
+
+        CacheBlk* blk = targets[target].tags->findBlock(arg.addr, arg.isSecure);
+        if (!blk || !blk->isValid())
+            return;
+
+        applyPermanentFaults(target, blk, arg.addr);
+    }
+
+    void
+    CHAOSCache::aceInterval(int target, CacheBlk *blk, unsigned begin, unsigned end, bool ace)
+    {
+        Target &t = targets[target];
+
+        // Closes the interval of bytes [begin, end) of the block at the
+        // current tick: it was ACE if it ends with a read (or a dirty
+        // eviction), un-ACE if it ends with an overwrite or a clean eviction.
+        Tick now = curTick();
+        Tick *last = &t.ace_last_event[(size_t(blk->getSet()) * t.assoc + blk->getWay()) * t.block_size];
+
+        double byte_ticks = 0;
+        for (unsigned i = begin; i < end; i++) {
+            byte_ticks += now - last[i];
+            last[i] = now;
+        }
+
+        if (ace) {
+            t.avf_stats->aceByteTicks += byte_ticks;
+            t.avf_stats->setAceByteTicks[blk->getSet()] += byte_ticks;
+        } else {
+            t.avf_stats->unAceByteTicks += byte_ticks;
+        }
+    }
+
+    void
+    CHAOSCache::notifyAceAccess(int target, const CacheAccessProbeArg &arg)
+    {
+        Target &t = targets[target];
+
+        // The probe fires once the hit is serviced, before it is turned
+        // into a response: reads carry no data yet, and writes have
+        // already gone through the data update probe
+        PacketPtr pkt = arg.pkt;
+        if (!(pkt->isRead() || pkt->isWrite()) || pkt->getSize() == 0)
+            return;
+
+        CacheBlk* blk = t.tags->findBlock(pkt->getAddr(), pkt->isSecure());
+        if (!blk || !blk->isValid())
+            return;
+
+        unsigned offset = pkt->getOffset(t.block_size);
+        unsigned end = std::min<unsigned>(offset + pkt->getSize(), t.block_size);
+        if (pkt->isRead()) {
+            aceInterval(target, blk, offset, end, true);
+        }
+        if (pkt->isWrite()) {
+            // Every written byte starts a new lifetime, whether its value
+            // changed or not
+            aceInterval(target, blk, offset, end, false);
+            t.ace_dirty[size_t(blk->getSet()) * t.assoc + blk->getWay()] = blk->isSet(CacheBlk::DirtyBit);
+        }
+    }
+
+    void
+    CHAOSCache::notifyAceMiss(int target, const CacheAccessProbeArg &arg)
+    {
+        Target &t = targets[target];
+
+        // Reads serviced by the fill get no hit probe: their bytes are
+        // read when the fill of the block is seen
+        PacketPtr pkt = arg.pkt;
+        if (!t.ace_track_misses || !pkt->isRead() || pkt->getSize() == 0 || pkt->req->isUncacheable())
+            return;
+
+        unsigned offset = pkt->getOffset(t.block_size);
+        t.ace_pending_reads[pkt->getBlockAddr(t.block_size)].emplace_back(
+            offset, std::min<unsigned>(offset + pkt->getSize(), t.block_size));
+    }
+
+    void
+    CHAOSCache::notifyAceDataUpdate(int target, const CacheDataUpdateProbeArg &arg)
+    {
+        Target &t = targets[target];
+        unsigned block_size = t.block_size;
+        CacheBlk* blk = t.tags->findBlock(arg.addr, arg.isSecure);
+        if (!blk)
+            return;
+
+        size_t frame = size_t(blk->getSet()) * t.assoc + blk->getWay();
+        Tick *last = &t.ace_last_event[frame * block_size];
+
+        if (arg.oldData.empty()) {
+            // Fill: the lifetime of every byte starts now, and the reads
+            // that missed on the block are serviced from it
+            std::fill(last, last + block_size, curTick());
+            t.ace_dirty[frame] = blk->isSet(CacheBlk::DirtyBit);
+            auto pending = t.ace_pending_reads.find(arg.addr);
+            if (pending != t.ace_pending_reads.end()) {
+                for (const auto &range : pending->second) {
+                    aceInterval(target, blk, range.first, range.second, true);
+                }
+                t.ace_pending_reads.erase(pending);
+            }
+        } else if (arg.newData.empty()) {
+            // Eviction or invalidation: dirty data is read by the writeback.
+            // The dirty bit is already cleared by then, the frame keeps it.
+            aceInterval(target, blk, 0, block_size, t.ace_dirty[frame]);
+            t.ace_dirty[frame] = false;
+        } else {
+            // Write: the bytes whose value changes end their lifetime here.
+            // The hit probe then ends that of the other written bytes, and
+            // records the dirty bit, set after the data by the cache.
+            const uint8_t *old_data = reinterpret_cast<const uint8_t *>(arg.oldData.data());
+            const uint8_t *new_data = reinterpret_cast<const uint8_t *>(arg.newData.data());
+            for (unsigned i = 0; i < block_size; i++) {
+                if (old_data[i] != new_data[i]) {
+                    aceInterval(target, blk, i, i + 1, false);
                 }
             }
+            t.ace_dirty[frame] = true;
         }
     }
 } // namespace gem5
\ No newline at end of file
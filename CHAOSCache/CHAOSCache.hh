@@ -15,7 +15,15 @@
 #include <random>
 #include <stdexcept>
 #include "base/output.hh"
+#include "CHAOSCommon/binary_log.hh"
+#include "CHAOSCommon/fault_schedule.hh"
+#include "CHAOSCommon/injection_observer.hh"
+#include "CHAOSCommon/philox.hh"
+#include "sim/probe/probe.hh"
 #include <map>
+#include <memory>
+#include <unordered_map>
+#include <vector>
 
 namespace gem5
 {
@@ -26,6 +34,21 @@ class CHAOSCache : public SimObject
     CHAOSCache(const CHAOSCacheParams& params);
     virtual ~CHAOSCache() {}
 
+    void regProbeListeners() override;
+    void startup() override;
+    void serialize(CheckpointOut &cp) const override;
+    void unserialize(CheckpointIn &cp) override;
+
+    // Campaign mode: arm the injector for experiment 'experiment' from the
+    // current tick, with an RNG stream of its own (called after a fork).
+    void startExperiment(uint64_t experiment);
+
+    // Campaign mode: inject the given fault (a fault schedule record,
+    // see CHAOSCommon/fault_schedule.hh) at 'when'. Faults armed in the
+    // same run must be given in time order.
+    void armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                  uint32_t fault_type, uint64_t mask);
+
   private:
     enum class FaultType {
       BitFlip,
@@ -37,10 +60,28 @@ class CHAOSCache : public SimObject
     struct PermanentFault {
       FaultType fault_type;
       uint64_t mask;
-      bool update;
     };
 
-    Cache* targetCache;
+    // Spatial shape of a fault: independent bytes, or one multi-bit upset
+    // built as a line-wide mask and applied in a single pass
+    enum class MBUPattern {
+      Bytes,       // corruption_size independent bytes
+      Adjacent,    // mbu_bits adjacent bits, across byte boundaries
+      Word,        // mbu_bits bits of one aligned 64-bit word
+      ColumnSets,  // Adjacent, at the same position of neighbouring sets
+      ColumnWays   // Adjacent, at the same position of neighbouring ways
+    };
+
+    // Part of the block frame hit by a fault. All picks one of the others
+    // with the weight of its number of bits.
+    enum class FaultTarget {
+      Data,
+      Tag,
+      Coherence,   // valid, writable, readable and dirty bits
+      Replacement,
+      All
+    };
+
     double probability;
     int bits_to_change;
     int corruption_size;
@@ -49,27 +90,65 @@ class CHAOSCache : public SimObject
     unsigned char fault_mask;
     int tick_to_clock_ratio;
     float bit_flip_prob, stuck_at_zero_prob, stuck_at_one_prob;
-    int cycles_permament_fault_check;
     bool write_log;
+    bool binary_log;
+    bool campaign_mode;
+    uint64_t seed, experiment;
+    bool use_schedule;
+    chaos::FaultSchedule fault_schedule;
+    bool ace_analysis;
+    MBUPattern mbu_pattern;
+    int mbu_bits, mbu_blocks;
+    // Line-wide mask of the current multi-bit upset
+    std::vector<uint8_t> line_mask;
+    FaultTarget fault_target;
 
-    EventFunctionWrapper attackEvent, periodicCheck;
-    Tick first_tick, last_tick, ticks_permament_fault_check;
-    std::map<std::pair<Addr, int>, PermanentFault> permanent_faults;
+    EventFunctionWrapper attackEvent;
+    Tick first_tick, last_tick;
+    // Tick of the pending injection read from a checkpoint, applied in
+    // startup() (MaxTick: not scheduled)
+    bool restored;
+    Tick restored_attack_tick;
+    std::vector<std::unique_ptr<ProbeListener>> listeners;
     std::geometric_distribution<unsigned> inter_fault_cycles_dist;
+    // Cache hit by each draw of the merged fault stream
+    std::discrete_distribution<int> target_dist;
     std::discrete_distribution<int> random_fault_distribution;
     
-    std::mt19937 rng;
+    chaos::Philox rng;
     std::random_device rd;
     OutputStream *log_stream;
+    chaos::BinaryLog bin_log;
     
     static FaultType stringToFaultType(const std::string &s);
+    static MBUPattern stringToMBUPattern(const std::string &s);
+    static const char *mbuPatternName(MBUPattern p);
+    static FaultTarget stringToFaultTarget(const std::string &s);
+    static const char *faultTargetName(FaultTarget f);
     const char* faultTypeToString(CHAOSCache::FaultType f);
+    void openLog();
+    void seedRng();
     void scheduleAttack(Tick tick);
-    void scheduleCheckPermanentFault(Tick time);
-    BaseTags* getTags() const;
-    uint8_t generateRandomMask(std::mt19937 &rng, int bits_to_change, unsigned size);
+    bool isInjecting() const;
+    static BaseTags* getTags(Cache *cache);
+    CacheBlk* pickRandomValidBlock(int target);
+    uint8_t generateRandomMask(chaos::Philox &rng, int bits_to_change, unsigned size);
     void injectFault();
-    void checkPermanent();
+    void injectScheduled();
+    void buildLineMask(unsigned block_size);
+    void injectPattern(int target, CacheBlk *blk, FaultType fault_type);
+    bool corruptLine(int target, CacheBlk *blk, FaultType fault_type);
+    void countFault(int target, FaultType fault_type);
+    void corruptMetadata(int target, CacheBlk *blk, FaultTarget field, FaultType fault_type);
+    bool retag(int target, CacheBlk *blk, Addr old_addr, Addr new_addr);
+    void corruptByte(int target, CacheBlk *blk, Addr blockAddr, int byteOffset,
+                     FaultType fault_type, uint8_t mask);
+    void applyPermanentFaults(int target, CacheBlk *blk, Addr blockAddr);
+    void notifyDataUpdate(int target, const CacheDataUpdateProbeArg &arg);
+    void aceInterval(int target, CacheBlk *blk, unsigned begin, unsigned end, bool ace);
+    void notifyAceAccess(int target, const CacheAccessProbeArg &arg);
+    void notifyAceMiss(int target, const CacheAccessProbeArg &arg);
+    void notifyAceDataUpdate(int target, const CacheDataUpdateProbeArg &arg);
 
     struct CHAOSCacheStats : public statistics::Group
     {
@@ -78,11 +157,67 @@ class CHAOSCache : public SimObject
       statistics::Scalar numStuckAtZero;
       statistics::Scalar numStuckAtOne;
       statistics::Scalar numPermanentFaults;
+      statistics::Scalar numDataFaults;
+      statistics::Scalar numMetadataFaults;
+      statistics::Scalar numTagFaults;
+      statistics::Scalar numCoherenceFaults;
+      statistics::Scalar numReplacementFaults;
+      statistics::Scalar numTagAliases;
+      statistics::Vector cacheFaultsInjected;
+      statistics::Vector cacheBitFlips;
+      statistics::Vector cacheStuckAtZero;
+      statistics::Vector cacheStuckAtOne;
       
-      CHAOSCacheStats(statistics::Group *parent);
+      CHAOSCacheStats(statistics::Group *parent, const std::vector<std::string> &caches);
     };
 
     std::unique_ptr<CHAOSCacheStats> stats;
+
+    struct CHAOSCacheAVFStats : public statistics::Group
+    {
+      statistics::Scalar aceByteTicks;
+      statistics::Scalar unAceByteTicks;
+      statistics::Scalar elapsedTicks;
+      statistics::Vector setAceByteTicks;
+      statistics::Formula avf;
+      statistics::Formula setAvf;
+
+      CHAOSCacheAVFStats(statistics::Group *parent, const std::string &name,
+                         uint32_t num_sets, uint64_t set_bytes);
+      void preDumpStats() override;
+    };
+
+    // One target cache and the state kept for it
+    struct Target
+    {
+      Cache *cache;
+      BaseTags *tags;
+      // Geometry of the tags, used to draw blocks by set/way.
+      // num_sets is 0 when the tags are not set-associative.
+      uint32_t num_sets, assoc;
+      unsigned block_size;
+      uint64_t capacity_bits;
+      // Tag faults hit the address bits [tag_shift, tag_shift + tag_bits)
+      unsigned tag_shift, tag_bits;
+      // Field hit by each fault with faultTarget=all
+      std::discrete_distribution<int> field_dist;
+      // Keyed by (block address, byte offset), so all the stuck bytes of a
+      // block are contiguous and found with a single lower_bound.
+      std::map<std::pair<Addr, int>, PermanentFault> permanent_faults;
+      // ACE analysis: time of the last read, write or fill of every byte of
+      // every block frame, indexed by (set * assoc + way) * block_size + byte.
+      std::vector<Tick> ace_last_event;
+      // Dirty state of every block frame as of its last write or fill:
+      // writebackBlk() clears the bit before the eviction is seen
+      std::vector<bool> ace_dirty;
+      // Byte ranges of the read misses waiting for their fill, by block
+      // address (not kept for mostly exclusive caches, which do not fill)
+      bool ace_track_misses;
+      std::unordered_map<Addr, std::vector<std::pair<unsigned, unsigned>>> ace_pending_reads;
+      std::unique_ptr<CHAOSCacheAVFStats> avf_stats;
+    };
+
+    std::vector<Target> targets;
 };
 
 } // namespace gem5
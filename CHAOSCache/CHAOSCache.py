@@ -1,13 +1,18 @@
 from m5.params import *
 from m5.proxy import *
 from m5.SimObject import SimObject
+from m5.util.pybind import PyBindMethod
 
 class CHAOSCache(SimObject):
     type = 'CHAOSCache'
     cxx_header = "mem/cache/CHAOSCache/CHAOSCache.hh"
     cxx_class = 'gem5::CHAOSCache'
-    target_cache = Param.Cache("Cache da corrompere")
-    probability = Param.Float(0.0, "Probability (between 0 and 1) of injecting faults")
+    cxx_exports = [PyBindMethod("startExperiment"), PyBindMethod("armFault")]
+    target_cache = Param.Cache(NULL, "Cache da corrompere")
+    target_caches = VectorParam.Cache([], "Target caches, sharing one fault stream (default: [target_cache])")
+    probability = Param.Float(0.0, "Probability (between 0 and 1) of injecting faults, per cycle and cache (whole hierarchy with capacityWeighted)")
+    cacheProbabilities = VectorParam.Float([], "Per-cache probabilities, one per target cache (default: probability for every cache)")
+    capacityWeighted = Param.Bool(False, "Split probability across the target caches in proportion to their capacity in bits")
     bitsToChange = Param.Int(-1, "Bit to modify per byte")
     faultMask = Param.String("0", "Bit mask to be applied to the target cache packet value")
     corruptionSize = Param.Int(1, "Bytes to modify")
@@ -18,5 +23,16 @@ class CHAOSCache(SimObject):
     bitFlipProb = Param.Float(0.9, "Probability (between 0 and 1) of injecting a bit flip fault on 'random' fault type")
     stuckAtZeroProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-zero fault on 'random' fault type")
     stuckAtOneProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-one flip fault on 'random' fault type")
-    cyclesPermamentFaultCheck = Param.Int(1, "Number of cycles between each periodic check for permanent faults.")
-    writeLog = Param.Bool(True, "Write a log file")
\ No newline at end of file
+    cyclesPermamentFaultCheck = Param.Int(1, "Unused: stuck-at faults are re-applied whenever the block data is updated. Kept for compatibility.")
+    writeLog = Param.Bool(True, "Write a log file")
+    logFormat = Param.String("text", "Log format: text, or binary (buffered fixed-size records, decoded by tools/decode_log.py)")
+    campaignMode = Param.Bool(False, "Stay idle until startExperiment() is called (fork-based campaigns)")
+    seed = Param.UInt64(0, "Seed of the fault injection RNG (0 picks a random seed, reported at startup)")
+    experiment = Param.UInt64(0, "Experiment index, selects an independent RNG stream for the same seed")
+    faultSchedule = Param.String("", "Binary fault schedule to replay instead of sampling faults online (times in ticks)")
+    aceAnalysis = Param.Bool(False, "Estimate the AVF of the target cache from the byte lifetimes (ACE analysis), reported in the stats")
+    mbuPattern = Param.String("bytes", "Spatial fault pattern: bytes (corruptionSize independent bytes), adjacent, word, column_sets, column_ways")
+    mbuBits = Param.Int(2, "Bits upset by one adjacent, word or column fault")
+    mbuBlocks = Param.Int(2, "Neighbouring sets (column_sets) or ways (column_ways) hit by one column fault")
+    faultTarget = Param.String("data", "Part of the block hit by the faults: data, tag, coherence, replacement, or all (weighted by bits)")
+    physAddrBits = Param.Int(48, "Physical address width, which bounds the tag bits hit by tag faults")
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "CHAOSCommon/binary_log.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
+#include "base/logging.hh"
+#include "base/statistics.hh"
+#include "sim/core.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+BinaryLog::~BinaryLog()
+{
+    close();
+}
+
+void
+BinaryLog::open(const std::string &file, const std::vector<std::string> &strings,
+                uint32_t num_targets, size_t buffer_records)
+{
+    close();
+
+    path = file;
+    fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        fatal("Could not open binary log %s: %s\n", path, strerror(errno));
+    }
+
+    buffer.resize(buffer_records);
+    used = 0;
+
+    std::string string_table;
+    for (const auto &s : strings) {
+        string_table.append(s);
+        string_table.push_back('\0');
+    }
+
+    LogHeader header = {};
+    std::memcpy(header.magic, "CHAOSLG", 8);
+    header.version = version;
+    header.record_size = sizeof(LogRecord);
+    header.strings_size = string_table.size();
+    header.num_targets = num_targets;
+    writeAll(&header, sizeof(header));
+    writeAll(string_table.data(), string_table.size());
+
+    // The buffer must reach the file even when the process ends without
+    // destroying the SimObjects (e.g. forked campaign children, which dump
+    // their stats and call os._exit()).
+    if (!callbacks_registered) {
+        statistics::registerDumpCallback([this] { flush(); });
+        registerExitCallback([this] { flush(); });
+        callbacks_registered = true;
+    }
+}
+
+void
+BinaryLog::flush()
+{
+    if (fd < 0 || used == 0)
+        return;
+
+    writeAll(buffer.data(), used * sizeof(LogRecord));
+    used = 0;
+}
+
+void
+BinaryLog::close()
+{
+    if (fd < 0)
+        return;
+
+    flush();
+    ::close(fd);
+    fd = -1;
+}
+
+void
+BinaryLog::writeAll(const void *data, size_t size)
+{
+    const char *bytes = static_cast<const char *>(data);
+    while (size > 0) {
+        ssize_t written = ::write(fd, bytes, size);
+        if (written < 0) {
+            if (errno == EINTR)
+                continue;
+            fatal("Could not write binary log %s: %s\n", path, strerror(errno));
+        }
+        bytes += written;
+        size -= written;
+    }
+}
+
+} // namespace chaos
+} // namespace gem5
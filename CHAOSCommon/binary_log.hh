@@ -0,0 +1,104 @@
+#ifndef __CHAOSCOMMON_BINARY_LOG_HH__
+#define __CHAOSCOMMON_BINARY_LOG_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gem5
+{
+namespace chaos
+{
+
+enum class LogKind : uint8_t {
+    Reg,      // target = register index, target2 = (CPU << 16) | thread, target3 = register class
+    Cache,    // target = block address, target2 = byte offset, target3 = cache
+    Mem,      // target = address, target2 = size in bytes, mask = first 8 mask bytes
+    MemMask,  // next 8 mask bytes of the preceding Mem, DRAM or CacheLine record (or Reg/O3 vector record)
+    RegError, // target2 = (CPU << 16) | thread
+    O3,       // target = physical register or sequence number, target2 = (CPU << 16) | field,
+              // target3 = O3 structure
+    DRAM,     // target = (row << 32) | column, target2 = (rank << 16) | bank,
+              // target3 = DRAM fault model, mask = first 8 bytes of the burst mask
+    CacheLine, // target = block address, target2 = (MBU pattern << 16) | blocks hit,
+               // target3 = cache, mask = first 8 bytes of the line mask
+    CacheMeta  // target = block address, target2 = field (1 tag, 2 coherence, 3 replacement),
+               // target3 = cache
+};
+
+// One injection in the binary log (little-endian, 32 bytes). Decoded back
+// to the text log format by tools/decode_log.py.
+struct LogRecord
+{
+    uint64_t time;       // CPU cycle (CHAOSReg) or tick
+    uint64_t target;
+    uint64_t mask;
+    uint32_t target2;
+    uint16_t target3;
+    LogKind kind;
+    uint8_t fault_type;  // 0 bit flip, 1 stuck-at-0, 2 stuck-at-1
+};
+
+static_assert(sizeof(LogRecord) == 32, "LogRecord must be 32 bytes");
+
+// Followed by 'strings_size' bytes of NUL-terminated strings (the names of
+// the 'num_targets' injector targets, then the register class names for
+// CHAOSReg), then by the records. Version 1 logs have a single target.
+struct LogHeader
+{
+    char magic[8];       // "CHAOSLG\0"
+    uint32_t version;
+    uint32_t record_size;
+    uint32_t strings_size;
+    uint32_t num_targets;
+};
+
+static_assert(sizeof(LogHeader) == 24, "LogHeader must be 24 bytes");
+
+// Fixed-record injection log. Records are copied into a large buffer and
+// written with a single write() when it fills up, when the stats are
+// dumped and when the simulation exits: nothing is formatted or flushed on
+// the injection path.
+class BinaryLog
+{
+  public:
+    static constexpr uint32_t version = 2;
+    static constexpr size_t defaultBufferRecords = 32768;
+
+    BinaryLog() = default;
+    ~BinaryLog();
+
+    BinaryLog(const BinaryLog &) = delete;
+    BinaryLog &operator=(const BinaryLog &) = delete;
+
+    void open(const std::string &path, const std::vector<std::string> &strings,
+              uint32_t num_targets = 1, size_t buffer_records = defaultBufferRecords);
+    bool isOpen() const { return fd >= 0; }
+
+    void
+    append(const LogRecord &record)
+    {
+        if (used == buffer.size()) {
+            flush();
+        }
+        buffer[used++] = record;
+    }
+
+    void flush();
+    void close();
+
+  private:
+    std::string path;
+    int fd = -1;
+    std::vector<LogRecord> buffer;
+    size_t used = 0;
+    bool callbacks_registered = false;
+
+    void writeAll(const void *data, size_t size);
+};
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_BINARY_LOG_HH__
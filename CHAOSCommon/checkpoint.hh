@@ -0,0 +1,68 @@
+#ifndef __CHAOSCOMMON_CHECKPOINT_HH__
+#define __CHAOSCOMMON_CHECKPOINT_HH__
+
+#include <string>
+
+#include "base/types.hh"
+#include "sim/eventq.hh"
+#include "sim/serialize.hh"
+#include "CHAOSCommon/philox.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+// Checkpoint helpers shared by the injectors. The generator is saved as
+// (key, stream, position), which is all a Philox state is made of.
+inline void
+serializeRng(CheckpointOut &cp, const Philox &rng)
+{
+    paramOut(cp, "rngKey", rng.getSeed());
+    paramOut(cp, "rngStream", rng.getStream());
+    paramOut(cp, "rngPosition", rng.position());
+}
+
+inline void
+unserializeRng(CheckpointIn &cp, Philox &rng)
+{
+    uint64_t key, stream, position;
+    paramIn(cp, "rngKey", key);
+    paramIn(cp, "rngStream", stream);
+    paramIn(cp, "rngPosition", position);
+    rng.seed(key, stream);
+    rng.setPosition(position);
+}
+
+// Pending events are saved as their tick (MaxTick if not scheduled) and
+// rescheduled by the injectors in startup(), once the events created by
+// their constructors have been dropped.
+inline void
+serializeEventTick(CheckpointOut &cp, const std::string &name, const Event &event)
+{
+    paramOut(cp, name, event.scheduled() ? event.when() : MaxTick);
+}
+
+inline Tick
+unserializeEventTick(CheckpointIn &cp, const std::string &name)
+{
+    Tick when;
+    paramIn(cp, name, when);
+    return when;
+}
+
+inline void
+restoreEvent(EventManager &manager, Event &event, Tick when)
+{
+    if (event.scheduled()) {
+        manager.deschedule(event);
+    }
+    if (when != MaxTick) {
+        manager.schedule(event, when);
+    }
+}
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_CHECKPOINT_HH__
@@ -0,0 +1,193 @@
+#include "CHAOSCommon/fault_overlay.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+
+#include "base/logging.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+size_t
+FaultOverlay::rank(const Page &page, unsigned c)
+{
+    // Number of present chunks before chunk c of the page
+    size_t n = 0;
+    for (unsigned w = 0; w < c / 64; w++) {
+        n += __builtin_popcountll(page.present[w]);
+    }
+    uint64_t below = (uint64_t(1) << (c % 64)) - 1;
+    return n + __builtin_popcountll(page.present[c / 64] & below);
+}
+
+FaultOverlay::Chunk &
+FaultOverlay::chunkAt(uint64_t chunk_addr)
+{
+    Page &page = pages[chunk_addr >> pageBits];
+    unsigned c = (chunk_addr & (pageBytes - 1)) / chunkBytes;
+    size_t idx = rank(page, c);
+    uint64_t bit = uint64_t(1) << (c % 64);
+
+    if (!(page.present[c / 64] & bit)) {
+        // A new chunk has no stuck bit yet
+        Chunk chunk;
+        std::memset(chunk.and_mask, 0xff, chunkBytes);
+        std::memset(chunk.or_mask, 0, chunkBytes);
+        page.chunks.insert(page.chunks.begin() + idx, chunk);
+        page.present[c / 64] |= bit;
+        num_chunks++;
+    }
+    return page.chunks[idx];
+}
+
+void
+FaultOverlay::add(uint64_t addr, const uint8_t *mask, size_t len, MaskOp op)
+{
+    uint64_t base = addr;
+    uint64_t end = addr + len;
+    while (addr < end) {
+        uint64_t chunk_addr = addr & ~uint64_t(chunkBytes - 1);
+        uint64_t stop = std::min(end, chunk_addr + chunkBytes);
+
+        // Chunks are only created for bytes that have stuck bits
+        bool any = false;
+        for (uint64_t a = addr; a < stop && !any; a++) {
+            any = mask[a - base] != 0;
+        }
+        if (any) {
+            Chunk &chunk = chunkAt(chunk_addr);
+            for (uint64_t a = addr; a < stop; a++) {
+                uint8_t m = mask[a - base];
+                unsigned off = a - chunk_addr;
+                if (op == MaskOp::Set) {
+                    chunk.and_mask[off] |= m;
+                    chunk.or_mask[off] |= m;
+                } else {
+                    chunk.and_mask[off] &= ~m;
+                    chunk.or_mask[off] &= ~m;
+                }
+            }
+        }
+        addr = stop;
+    }
+}
+
+void
+FaultOverlay::setChunk(uint64_t addr, const uint8_t *and_mask, const uint8_t *or_mask)
+{
+    Chunk &chunk = chunkAt(addr & ~uint64_t(chunkBytes - 1));
+    std::memcpy(chunk.and_mask, and_mask, chunkBytes);
+    std::memcpy(chunk.or_mask, or_mask, chunkBytes);
+}
+
+void
+FaultOverlay::apply(uint64_t addr, uint8_t *data, size_t len) const
+{
+    if (pages.empty() || len == 0)
+        return;
+
+    uint64_t end = addr + len;
+    for (uint64_t page_addr = addr & ~(pageBytes - 1); page_addr < end; page_addr += pageBytes) {
+        auto it = pages.find(page_addr >> pageBits);
+        if (it == pages.end())
+            continue;
+
+        const Page &page = it->second;
+        uint64_t start = std::max(addr, page_addr);
+        uint64_t stop = std::min(end, page_addr + pageBytes);
+        unsigned first = (start - page_addr) / chunkBytes;
+        unsigned last = (stop - 1 - page_addr) / chunkBytes;
+
+        // Walk the present chunks of [first, last] only
+        size_t idx = rank(page, first);
+        for (unsigned w = first / 64; w <= last / 64; w++) {
+            uint64_t bits = page.present[w];
+            if (w == first / 64)
+                bits &= ~uint64_t(0) << (first % 64);
+            if (w == last / 64 && last % 64 != 63)
+                bits &= (uint64_t(1) << (last % 64 + 1)) - 1;
+
+            for (; bits; bits &= bits - 1) {
+                unsigned c = w * 64 + __builtin_ctzll(bits);
+                const Chunk &chunk = page.chunks[idx++];
+                uint64_t chunk_addr = page_addr + c * chunkBytes;
+                uint64_t lo = std::max(start, chunk_addr);
+                uint64_t hi = std::min(stop, chunk_addr + chunkBytes);
+                applyStuckMasks(data + (lo - addr), chunk.and_mask + (lo - chunk_addr),
+                                chunk.or_mask + (lo - chunk_addr), hi - lo);
+            }
+        }
+    }
+}
+
+uint64_t
+FaultOverlay::load(const std::string &path, uint64_t start, uint64_t end, uint64_t &skipped)
+{
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fatal("Could not open fault map %s: %s\n", path, strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(FaultMapHeader)) {
+        fatal("Fault map %s is too short\n", path);
+    }
+    size_t mapping_size = st.st_size;
+
+    void *mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        fatal("Could not map fault map %s: %s\n", path, strerror(errno));
+    }
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    const auto *header = static_cast<const FaultMapHeader *>(mapping);
+    if (std::memcmp(header->magic, "CHAOSFM", 8) != 0 ||
+        header->version != mapVersion ||
+        header->record_size != sizeof(FaultMapRecord)) {
+        fatal("%s is not a version %d CHAOS fault map\n", path, mapVersion);
+    }
+
+    if (sizeof(FaultMapHeader) + header->num_records * sizeof(FaultMapRecord) > mapping_size) {
+        fatal("Fault map %s is truncated\n", path);
+    }
+
+    const auto *records = reinterpret_cast<const FaultMapRecord *>(
+        static_cast<const uint8_t *>(mapping) + sizeof(FaultMapHeader));
+    uint64_t loaded = 0;
+    skipped = 0;
+    for (uint64_t i = 0; i < header->num_records; i++) {
+        const FaultMapRecord &record = records[i];
+        uint8_t mask[sizeof(record.mask)];
+        for (size_t b = 0; b < sizeof(mask); b++) {
+            mask[b] = uint8_t(record.mask >> (8 * b));
+        }
+
+        size_t size = sizeof(mask);
+        while (size > 0 && mask[size - 1] == 0) {
+            size--;
+        }
+
+        if (size == 0 || record.addr < start || record.addr + size - 1 > end ||
+            (record.fault_type != 1 && record.fault_type != 2)) {
+            skipped++;
+            continue;
+        }
+
+        add(record.addr, mask, size, record.fault_type == 1 ? MaskOp::Clear : MaskOp::Set);
+        loaded++;
+    }
+
+    munmap(mapping, mapping_size);
+    return loaded;
+}
+
+} // namespace chaos
+} // namespace gem5
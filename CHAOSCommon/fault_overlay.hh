@@ -0,0 +1,116 @@
+#ifndef __CHAOSCOMMON_FAULT_OVERLAY_HH__
+#define __CHAOSCOMMON_FAULT_OVERLAY_HH__
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "CHAOSCommon/mask_kernels.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+// One stuck-at entry of a fault map file (little-endian, 24 bytes).
+// The mask bytes cover addr..addr+7, byte 0 being the lowest address.
+struct FaultMapRecord
+{
+    uint64_t addr;
+    uint64_t mask;
+    uint8_t fault_type;  // 1 stuck-at-0, 2 stuck-at-1
+    uint8_t reserved[7];
+};
+
+static_assert(sizeof(FaultMapRecord) == 24, "FaultMapRecord must be 24 bytes");
+
+struct FaultMapHeader
+{
+    char magic[8];       // "CHAOSFM\0"
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t num_records;
+};
+
+static_assert(sizeof(FaultMapHeader) == 24, "FaultMapHeader must be 24 bytes");
+
+// Stuck-at cells of a physical address space, kept as a sparse two-level
+// table: pages are found by a hash of their number, and inside a page a
+// bitmap tells which 16-byte chunks hold stuck cells. Each present chunk
+// stores an AND and an OR mask, so a stuck byte reads as
+// (data & and_mask) | or_mask. Millions of cells take a few tens of bytes
+// each and a packet costs one lookup per page it touches.
+class FaultOverlay
+{
+  public:
+    static constexpr unsigned pageBits = 12;
+    static constexpr uint64_t pageBytes = uint64_t(1) << pageBits;
+    static constexpr unsigned chunkBytes = 16;
+    static constexpr unsigned chunksPerPage = pageBytes / chunkBytes;
+    static constexpr uint32_t mapVersion = 1;
+
+    // Adds stuck bits over len bytes from addr: op is MaskOp::Clear
+    // (stuck-at-0) or MaskOp::Set (stuck-at-1). A later fault on the same
+    // bit replaces the earlier one.
+    void add(uint64_t addr, const uint8_t *mask, size_t len, MaskOp op);
+
+    // Forces the stuck bits on a copy of [addr, addr + len)
+    void apply(uint64_t addr, uint8_t *data, size_t len) const;
+
+    // Loads a fault map file. Records not entirely inside [start, end]
+    // are counted in 'skipped' and ignored. Returns the records loaded.
+    uint64_t load(const std::string &path, uint64_t start, uint64_t end, uint64_t &skipped);
+
+    bool empty() const { return pages.empty(); }
+    uint64_t numChunks() const { return num_chunks; }
+    void clear() { pages.clear(); num_chunks = 0; }
+
+    // Raw chunk access, used to save and restore the overlay
+    void setChunk(uint64_t addr, const uint8_t *and_mask, const uint8_t *or_mask);
+
+    // Calls f(addr, and_mask, or_mask) for every chunk, in no given order
+    template <typename F>
+    void
+    forEachChunk(F f) const
+    {
+        for (const auto &entry : pages) {
+            const Page &page = entry.second;
+            size_t idx = 0;
+            for (unsigned w = 0; w < page.present.size(); w++) {
+                for (uint64_t bits = page.present[w]; bits; bits &= bits - 1) {
+                    unsigned c = w * 64 + __builtin_ctzll(bits);
+                    const Chunk &chunk = page.chunks[idx++];
+                    f((entry.first << pageBits) + c * chunkBytes, chunk.and_mask, chunk.or_mask);
+                }
+            }
+        }
+    }
+
+  private:
+    struct Chunk
+    {
+        uint8_t and_mask[chunkBytes];
+        uint8_t or_mask[chunkBytes];
+    };
+
+    struct Page
+    {
+        std::array<uint64_t, chunksPerPage / 64> present{};
+        // Present chunks in address order
+        std::vector<Chunk> chunks;
+    };
+
+    static size_t rank(const Page &page, unsigned c);
+    Chunk &chunkAt(uint64_t chunk_addr);
+
+    std::unordered_map<uint64_t, Page> pages;
+    uint64_t num_chunks = 0;
+};
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_FAULT_OVERLAY_HH__
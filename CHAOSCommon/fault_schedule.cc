@@ -0,0 +1,102 @@
+#include "CHAOSCommon/fault_schedule.hh"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstring>
+
+#include "base/logging.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+FaultSchedule::~FaultSchedule()
+{
+    if (mapping) {
+        munmap(mapping, mapping_size);
+    }
+}
+
+void
+FaultSchedule::open(const std::string &file)
+{
+    path = file;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        fatal("Could not open fault schedule %s: %s\n", path, strerror(errno));
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) < 0 || size_t(st.st_size) < sizeof(FaultScheduleHeader)) {
+        fatal("Fault schedule %s is too short\n", path);
+    }
+    mapping_size = st.st_size;
+
+    mapping = mmap(nullptr, mapping_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (mapping == MAP_FAILED) {
+        mapping = nullptr;
+        fatal("Could not map fault schedule %s: %s\n", path, strerror(errno));
+    }
+    madvise(mapping, mapping_size, MADV_SEQUENTIAL);
+
+    const auto *header = static_cast<const FaultScheduleHeader *>(mapping);
+    if (std::memcmp(header->magic, "CHAOSFS", 8) != 0 ||
+        header->version != version ||
+        header->record_size != sizeof(FaultRecord)) {
+        fatal("%s is not a version %d CHAOS fault schedule\n", path, version);
+    }
+
+    if (sizeof(FaultScheduleHeader) + header->num_records * sizeof(FaultRecord) > mapping_size) {
+        fatal("Fault schedule %s is truncated\n", path);
+    }
+
+    begin = reinterpret_cast<const FaultRecord *>(
+        static_cast<const uint8_t *>(mapping) + sizeof(FaultScheduleHeader));
+    cursor = begin;
+    end = begin + header->num_records;
+}
+
+void
+FaultSchedule::append(const FaultRecord &record)
+{
+    if (mapping) {
+        fatal("Fault schedule %s is mapped from a file, it cannot be extended\n", path);
+    }
+    if (path.empty()) {
+        path = "(in memory)";
+    }
+
+    uint64_t pos = position();
+    records.push_back(record);
+    begin = records.data();
+    cursor = begin + pos;
+    end = begin + records.size();
+}
+
+const FaultRecord &
+FaultSchedule::next()
+{
+    const FaultRecord &record = *cursor++;
+    if (cursor != end && cursor->when < record.when) {
+        fatal("Fault schedule %s is not sorted (record %d)\n", path, position());
+    }
+    return record;
+}
+
+void
+FaultSchedule::setPosition(uint64_t pos)
+{
+    if (pos > size()) {
+        fatal("Fault schedule %s has only %d records\n", path, size());
+    }
+    cursor = begin + pos;
+}
+
+} // namespace chaos
+} // namespace gem5
@@ -0,0 +1,87 @@
+#ifndef __CHAOSCOMMON_FAULT_SCHEDULE_HH__
+#define __CHAOSCOMMON_FAULT_SCHEDULE_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace gem5
+{
+namespace chaos
+{
+
+// One entry of a precompiled fault schedule (little-endian, 32 bytes).
+// The meaning of the target fields depends on the injector:
+//   CHAOSReg:   target = register index, target2 = (CPU << 16) | thread,
+//               target3 = register class
+//   CHAOSCache: target = set, target2 = (cache << 16) | way,
+//               target3 = byte offset in the block
+//   CHAOSMem:   target = physical address (mask bytes cover target..target+7)
+struct FaultRecord
+{
+    uint64_t when;       // CPU cycle (CHAOSReg) or tick (CHAOSCache, CHAOSMem)
+    uint64_t target;
+    uint32_t target2;
+    uint16_t target3;
+    uint8_t fault_type;  // 0 bit flip, 1 stuck-at-0, 2 stuck-at-1
+    uint8_t reserved;
+    uint64_t mask;
+};
+
+static_assert(sizeof(FaultRecord) == 32, "FaultRecord must be 32 bytes");
+
+struct FaultScheduleHeader
+{
+    char magic[8];       // "CHAOSFS\0"
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t num_records;
+};
+
+static_assert(sizeof(FaultScheduleHeader) == 24, "FaultScheduleHeader must be 24 bytes");
+
+// Read-only, memory-mapped fault schedule consumed sequentially by the
+// attack event. Records must be sorted by 'when'; no RNG or distribution
+// work is left on the injection path. A schedule that is not mapped from a
+// file can instead be filled at run time with append() (campaign drivers).
+class FaultSchedule
+{
+  public:
+    static constexpr uint32_t version = 1;
+
+    FaultSchedule() = default;
+    ~FaultSchedule();
+
+    FaultSchedule(const FaultSchedule &) = delete;
+    FaultSchedule &operator=(const FaultSchedule &) = delete;
+
+    void open(const std::string &path);
+    bool isOpen() const { return mapping != nullptr; }
+
+    // Adds a record at the end of an in-memory schedule
+    void append(const FaultRecord &record);
+
+    bool done() const { return cursor == end; }
+    const FaultRecord &peek() const { return *cursor; }
+    const FaultRecord &next();
+
+    // Index of the next record, used to save and restore the cursor
+    uint64_t position() const { return cursor - begin; }
+    void setPosition(uint64_t pos);
+    uint64_t size() const { return end - begin; }
+
+  private:
+    std::string path;
+    void *mapping = nullptr;
+    size_t mapping_size = 0;
+    const FaultRecord *begin = nullptr;
+    const FaultRecord *cursor = nullptr;
+    const FaultRecord *end = nullptr;
+    std::vector<FaultRecord> records;
+};
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_FAULT_SCHEDULE_HH__
@@ -0,0 +1,82 @@
+#ifndef __CHAOSCOMMON_INJECTION_OBSERVER_HH__
+#define __CHAOSCOMMON_INJECTION_OBSERVER_HH__
+
+#include <algorithm>
+#include <vector>
+
+#include "base/types.hh"
+
+namespace gem5
+{
+namespace chaos
+{
+
+// Interface for objects that need to know when an injector corrupts the
+// simulated state (e.g. CHAOSConvergence). Observers register themselves,
+// so the injectors can be built and used without them.
+class InjectionObserver
+{
+  public:
+    virtual ~InjectionObserver() = default;
+
+    // Called right before [addr, addr + size) is corrupted in memory or in
+    // a cache, while the data still holds its fault-free value.
+    virtual void beforeCorruption(Addr addr, Addr size) {}
+
+    // Called after every injection, of any injector.
+    virtual void faultInjected(bool permanent) {}
+
+    // Called with true when a fault is injected into state that is not
+    // architectural yet (an in-flight instruction), and with false once
+    // that state is committed or squashed.
+    virtual void faultInFlight(bool in_flight) {}
+};
+
+inline std::vector<InjectionObserver *> &
+injectionObservers()
+{
+    static std::vector<InjectionObserver *> observers;
+    return observers;
+}
+
+inline void
+registerInjectionObserver(InjectionObserver *observer)
+{
+    injectionObservers().push_back(observer);
+}
+
+inline void
+unregisterInjectionObserver(InjectionObserver *observer)
+{
+    auto &observers = injectionObservers();
+    observers.erase(std::remove(observers.begin(), observers.end(), observer), observers.end());
+}
+
+inline void
+notifyBeforeCorruption(Addr addr, Addr size)
+{
+    for (auto *observer : injectionObservers()) {
+        observer->beforeCorruption(addr, size);
+    }
+}
+
+inline void
+notifyFaultInjected(bool permanent)
+{
+    for (auto *observer : injectionObservers()) {
+        observer->faultInjected(permanent);
+    }
+}
+
+inline void
+notifyFaultInFlight(bool in_flight)
+{
+    for (auto *observer : injectionObservers()) {
+        observer->faultInFlight(in_flight);
+    }
+}
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_INJECTION_OBSERVER_HH__
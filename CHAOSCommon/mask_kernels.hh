@@ -0,0 +1,77 @@
+#ifndef __CHAOSCOMMON_MASK_KERNELS_HH__
+#define __CHAOSCOMMON_MASK_KERNELS_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace gem5
+{
+namespace chaos
+{
+
+enum class MaskOp {
+    Xor,    // bit flip
+    Clear,  // stuck at zero
+    Set     // stuck at one
+};
+
+// Byte-wise mask kernels shared by the injectors. The bulk of the buffer
+// is processed one 64-bit word at a time (memcpy keeps the accesses
+// alignment-safe), which the compiler turns into SIMD loads/stores.
+template <typename Op>
+inline void
+applyMaskKernel(uint8_t *data, const uint8_t *mask, size_t len, Op op)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t d, m;
+        std::memcpy(&d, data + i, sizeof(d));
+        std::memcpy(&m, mask + i, sizeof(m));
+        d = op(d, m);
+        std::memcpy(data + i, &d, sizeof(d));
+    }
+    for (; i < len; i++) {
+        data[i] = static_cast<uint8_t>(op(uint64_t(data[i]), uint64_t(mask[i])));
+    }
+}
+
+inline void
+applyMask(uint8_t *data, const uint8_t *mask, size_t len, MaskOp op)
+{
+    switch (op) {
+        case MaskOp::Xor:
+            applyMaskKernel(data, mask, len, [](uint64_t d, uint64_t m) { return d ^ m; });
+            break;
+        case MaskOp::Clear:
+            applyMaskKernel(data, mask, len, [](uint64_t d, uint64_t m) { return d & ~m; });
+            break;
+        case MaskOp::Set:
+            applyMaskKernel(data, mask, len, [](uint64_t d, uint64_t m) { return d | m; });
+            break;
+    }
+}
+
+// Stuck-at overlay: data = (data & and_mask) | or_mask, bytes with no
+// stuck bit having an all-ones AND mask and a zero OR mask
+inline void
+applyStuckMasks(uint8_t *data, const uint8_t *and_mask, const uint8_t *or_mask, size_t len)
+{
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t d, a, o;
+        std::memcpy(&d, data + i, sizeof(d));
+        std::memcpy(&a, and_mask + i, sizeof(a));
+        std::memcpy(&o, or_mask + i, sizeof(o));
+        d = (d & a) | o;
+        std::memcpy(data + i, &d, sizeof(d));
+    }
+    for (; i < len; i++) {
+        data[i] = (data[i] & and_mask[i]) | or_mask[i];
+    }
+}
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_MASK_KERNELS_HH__
@@ -0,0 +1,110 @@
+#ifndef __CHAOSCOMMON_PHILOX_HH__
+#define __CHAOSCOMMON_PHILOX_HH__
+
+#include <array>
+#include <cstdint>
+#include <limits>
+#include <string>
+
+namespace gem5
+{
+namespace chaos
+{
+
+// Counter-based Philox4x32-10 generator (Salmon et al., SC'11), shared by the
+// injectors. The output is a pure function of (key, counter): the key comes
+// from the seed, the upper half of the counter selects the stream (one per
+// experiment) and the lower half is the position inside the stream. Any
+// experiment, or any draw of it, is reached in O(1) with seed()/discard().
+// It satisfies UniformRandomBitGenerator, so it plugs into the <random>
+// distributions.
+class Philox
+{
+  public:
+    using result_type = uint32_t;
+
+    static constexpr result_type min() { return 0; }
+    static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+    Philox(uint64_t seed_value = 0, uint64_t stream = 0) { seed(seed_value, stream); }
+
+    void
+    seed(uint64_t seed_value, uint64_t stream = 0)
+    {
+        key = {uint32_t(seed_value), uint32_t(seed_value >> 32)};
+        stream_id = stream;
+        setPosition(0);
+    }
+
+    uint64_t getSeed() const { return uint64_t(key[1]) << 32 | key[0]; }
+    uint64_t getStream() const { return stream_id; }
+
+    // Number of 32-bit draws consumed in the current stream
+    uint64_t position() const { return block * 4 + index; }
+
+    void setPosition(uint64_t pos)
+    {
+        block = pos / 4;
+        index = pos % 4;
+        generate();
+    }
+
+    void discard(uint64_t n) { setPosition(position() + n); }
+
+    result_type
+    operator()()
+    {
+        if (index == 4) {
+            block++;
+            index = 0;
+            generate();
+        }
+        return output[index++];
+    }
+
+    // Stable 64-bit hash (FNV-1a), used to derive independent keys for
+    // different injector instances from the same user seed.
+    static uint64_t
+    hashName(const std::string &name)
+    {
+        uint64_t h = 0xcbf29ce484222325ULL;
+        for (unsigned char c : name) {
+            h ^= c;
+            h *= 0x100000001b3ULL;
+        }
+        return h;
+    }
+
+  private:
+    static constexpr uint32_t M0 = 0xD2511F53, M1 = 0xCD9E8D57;
+    static constexpr uint32_t W0 = 0x9E3779B9, W1 = 0xBB67AE85;
+
+    std::array<uint32_t, 2> key;
+    uint64_t stream_id;
+    uint64_t block;
+    unsigned index;
+    std::array<uint32_t, 4> output;
+
+    void
+    generate()
+    {
+        std::array<uint32_t, 4> ctr = {uint32_t(block), uint32_t(block >> 32),
+                                       uint32_t(stream_id), uint32_t(stream_id >> 32)};
+        std::array<uint32_t, 2> k = key;
+
+        for (int round = 0; round < 10; round++) {
+            uint64_t p0 = uint64_t(M0) * ctr[0];
+            uint64_t p1 = uint64_t(M1) * ctr[2];
+            ctr = {uint32_t(p1 >> 32) ^ ctr[1] ^ k[0], uint32_t(p1),
+                   uint32_t(p0 >> 32) ^ ctr[3] ^ k[1], uint32_t(p0)};
+            k[0] += W0;
+            k[1] += W1;
+        }
+        output = ctr;
+    }
+};
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_PHILOX_HH__
@@ -0,0 +1,49 @@
+#ifndef __CHAOSCOMMON_STATE_HASH_HH__
+#define __CHAOSCOMMON_STATE_HASH_HH__
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+namespace gem5
+{
+namespace chaos
+{
+
+// Finalizer of MurmurHash3, a cheap 64-bit bijective mixer
+inline uint64_t
+mix64(uint64_t x)
+{
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    x *= 0xc4ceb9fe1a85ec53ULL;
+    x ^= x >> 33;
+    return x;
+}
+
+// Non-cryptographic 64-bit hash of a buffer, one word per step. The seed
+// is used to tell apart equal contents at different addresses.
+inline uint64_t
+hashBytes(const void *data, size_t len, uint64_t seed)
+{
+    const uint8_t *bytes = static_cast<const uint8_t *>(data);
+    uint64_t h = mix64(seed ^ (len * 0x9e3779b97f4a7c15ULL));
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= len; i += sizeof(uint64_t)) {
+        uint64_t w;
+        std::memcpy(&w, bytes + i, sizeof(w));
+        h ^= w * 0x87c37b91114253d5ULL;
+        h = ((h << 31) | (h >> 33)) * 0x4cf5ad432745937fULL;
+    }
+
+    uint64_t tail = 0;
+    std::memcpy(&tail, bytes + i, len - i);
+    return mix64(h ^ tail);
+}
+
+} // namespace chaos
+} // namespace gem5
+
+#endif // __CHAOSCOMMON_STATE_HASH_HH__
@@ -0,0 +1,250 @@
+#include "CHAOSConvergence/CHAOSConvergence.hh"
+
+#include <fstream>
+
+#include "arch/generic/isa.hh"
+#include "base/logging.hh"
+#include "cpu/reg_class.hh"
+#include "cpu/thread_context.hh"
+#include "mem/port_proxy.hh"
+#include "sim/sim_exit.hh"
+#include "CHAOSCommon/state_hash.hh"
+
+namespace gem5 {
+
+    CHAOSConvergence::CHAOSConvergence(const CHAOSConvergenceParams &p)
+    : SimObject(p),
+    system(p.system),
+    record_golden(p.recordGolden),
+    golden_file(p.goldenFile),
+    check_interval(p.checkInterval),
+    tick_to_clock_ratio(p.tickToClockRatio),
+    block_size(p.system->cacheLineSize()),
+    injected(false),
+    permanent_fault(false),
+    in_flight_faults(0),
+    checkEvent([this] { this->check(); }, name()),
+    check_ticks(0),
+    mem_hash(0),
+    block_buffer(block_size),
+    golden_cursor(0),
+    golden_stream(nullptr),
+    caches(p.caches.begin(), p.caches.end()),
+    stats(std::make_unique<CHAOSConvergenceStats>(this))
+    {
+        if (golden_file.empty()) {
+            fatal("CHAOSConvergence: goldenFile must be set.\n");
+        }
+        if (check_interval == 0) {
+            fatal("CHAOSConvergence: checkInterval must be greater than 0.\n");
+        }
+        if (caches.empty()) {
+            warn("CHAOSConvergence: no caches given, memory written by the CPU is not tracked.\n");
+        }
+
+        check_ticks = check_interval * tick_to_clock_ratio;
+
+        if (record_golden) {
+            golden_stream = simout.create(golden_file, true, true);
+            if (!golden_stream || !golden_stream->stream()) {
+                panic("CHAOSConvergence: Could not open golden file %s", golden_file);
+            }
+        } else {
+            std::ifstream in(golden_file, std::ios::binary | std::ios::ate);
+            if (!in) {
+                fatal("CHAOSConvergence: Could not open golden file %s\n", golden_file);
+            }
+            size_t bytes = in.tellg();
+            golden.resize(bytes / sizeof(GoldenRecord));
+            in.seekg(0);
+            in.read(reinterpret_cast<char *>(golden.data()), golden.size() * sizeof(GoldenRecord));
+        }
+
+        chaos::registerInjectionObserver(this);
+    }
+
+    CHAOSConvergence::~CHAOSConvergence()
+    {
+        chaos::unregisterInjectionObserver(this);
+        if (golden_stream) {
+            simout.close(golden_stream);
+        }
+    }
+
+    CHAOSConvergence::CHAOSConvergenceStats::CHAOSConvergenceStats(statistics::Group *parent)
+    : statistics::Group(parent),
+      ADD_STAT(numChecks, statistics::units::Count::get(),
+               "Number of state digests computed"),
+      ADD_STAT(numBlocksHashed, statistics::units::Count::get(),
+               "Number of written memory blocks hashed"),
+      ADD_STAT(numTrackedBlocks, statistics::units::Count::get(),
+               "Number of distinct memory blocks written so far"),
+      ADD_STAT(convergenceTick, statistics::units::Tick::get(),
+               "Tick at which the faulty state matched the golden run (0 if never)")
+    {
+    }
+
+    void
+    CHAOSConvergence::regProbeListeners()
+    {
+        // Stores are seen when they update the L1 data caches, together with
+        // the block value before the write.
+        for (auto *cache : caches) {
+            listeners.push_back(std::make_unique<ProbeListenerArg<CHAOSConvergence, CacheDataUpdateProbeArg>>(
+                this, cache->getProbeManager(), "Data Update", &CHAOSConvergence::notifyDataUpdate));
+        }
+    }
+
+    void
+    CHAOSConvergence::startup()
+    {
+        SimObject::startup();
+
+        // Checks happen at multiples of the interval, so the golden and the
+        // faulty runs compare the same instants.
+        schedule(checkEvent, (curTick() / check_ticks + 1) * check_ticks);
+    }
+
+    void
+    CHAOSConvergence::trackBlock(Addr blk_addr, const uint8_t *old_data)
+    {
+        auto it = blocks.find(blk_addr);
+        if (it == blocks.end()) {
+            uint64_t base = chaos::hashBytes(old_data, block_size, blk_addr);
+            blocks.emplace(blk_addr, BlockHash{base, base, true});
+            pending_blocks.push_back(blk_addr);
+        } else if (!it->second.pending) {
+            it->second.pending = true;
+            pending_blocks.push_back(blk_addr);
+        }
+    }
+
+    void
+    CHAOSConvergence::notifyDataUpdate(const CacheDataUpdateProbeArg &arg)
+    {
+        // Fills (no old data) and evictions (no new data) do not change the
+        // memory image seen by the program.
+        if (arg.oldData.empty() || arg.newData.empty())
+            return;
+
+        trackBlock(arg.addr, reinterpret_cast<const uint8_t *>(arg.oldData.data()));
+    }
+
+    void
+    CHAOSConvergence::beforeCorruption(Addr addr, Addr size)
+    {
+        Addr blk_addr = addr & ~Addr(block_size - 1);
+        for (; blk_addr < addr + size; blk_addr += block_size) {
+            if (blocks.find(blk_addr) == blocks.end()) {
+                system->physProxy.readBlob(blk_addr, block_buffer.data(), block_size);
+            }
+            trackBlock(blk_addr, block_buffer.data());
+        }
+    }
+
+    void
+    CHAOSConvergence::faultInjected(bool permanent)
+    {
+        if (record_golden) {
+            fatal("CHAOSConvergence: a fault was injected while recording the golden run.\n");
+        }
+
+        injected = true;
+        permanent_fault = permanent_fault || permanent;
+    }
+
+    void
+    CHAOSConvergence::faultInFlight(bool in_flight)
+    {
+        in_flight_faults += in_flight ? 1 : -1;
+    }
+
+    uint64_t
+    CHAOSConvergence::hashRegisters() const
+    {
+        std::vector<uint8_t> regs;
+
+        for (int i = 0; i < system->threads.size(); i++) {
+            ThreadContext *tc = system->threads[i];
+
+            Addr pc = tc->pcState().instAddr();
+            const uint8_t *pc_bytes = reinterpret_cast<const uint8_t *>(&pc);
+            regs.insert(regs.end(), pc_bytes, pc_bytes + sizeof(pc));
+
+            for (const auto *reg_class : tc->getIsaPtr()->regClasses()) {
+                // Misc registers hold counters and reads may have side
+                // effects, vector elements alias the vector registers.
+                if (reg_class->type() == MiscRegClass || reg_class->type() == VecElemClass)
+                    continue;
+
+                size_t reg_bytes = reg_class->regBytes();
+                for (int idx = 0; idx < reg_class->numRegs(); idx++) {
+                    size_t offset = regs.size();
+                    regs.resize(offset + reg_bytes);
+                    tc->getReg(RegId(*reg_class, idx), regs.data() + offset);
+                }
+            }
+        }
+
+        return chaos::hashBytes(regs.data(), regs.size(), 0);
+    }
+
+    uint64_t
+    CHAOSConvergence::computeDigest()
+    {
+        // Only the blocks written since the previous check are read back,
+        // functionally, so dirty data still in the caches is included.
+        for (Addr blk_addr : pending_blocks) {
+            BlockHash &block = blocks[blk_addr];
+            system->physProxy.readBlob(blk_addr, block_buffer.data(), block_size);
+            uint64_t current = chaos::hashBytes(block_buffer.data(), block_size, blk_addr);
+
+            // Swap the block's old contribution for the new one
+            mem_hash ^= block.current ^ current;
+            block.current = current;
+            block.pending = false;
+        }
+        stats->numBlocksHashed += pending_blocks.size();
+        pending_blocks.clear();
+        stats->numTrackedBlocks = blocks.size();
+        stats->numChecks++;
+
+        return chaos::mix64(hashRegisters() ^ chaos::mix64(mem_hash));
+    }
+
+    void
+    CHAOSConvergence::check()
+    {
+        if (record_golden) {
+            GoldenRecord record = {curTick(), computeDigest()};
+            golden_stream->stream()->write(reinterpret_cast<const char *>(&record), sizeof(record));
+            schedule(checkEvent, curTick() + check_ticks);
+            return;
+        }
+
+        while (golden_cursor < golden.size() && golden[golden_cursor].tick < curTick()) {
+            golden_cursor++;
+        }
+
+        // The golden run ended earlier, nothing left to compare with
+        if (golden_cursor == golden.size())
+            return;
+
+        // A stuck-at fault keeps corrupting the state, it is never masked
+        if (permanent_fault)
+            return;
+
+        // Nothing to compare before the first fault, the state is golden.
+        // The digest only covers the architectural state, so it cannot
+        // tell a fault still held by an in-flight instruction.
+        if (injected && in_flight_faults == 0 && golden[golden_cursor].tick == curTick() &&
+            computeDigest() == golden[golden_cursor].digest) {
+            stats->convergenceTick = curTick();
+            exitSimLoop("CHAOS: state converged to the golden run, fault masked", 0);
+            return;
+        }
+
+        schedule(checkEvent, curTick() + check_ticks);
+    }
+
+} // namespace gem5
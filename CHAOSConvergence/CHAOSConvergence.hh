@@ -0,0 +1,103 @@
+#ifndef __CHAOSCONVERGENCE_HH__
+#define __CHAOSCONVERGENCE_HH__
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "base/output.hh"
+#include "base/statistics.hh"
+#include "mem/cache/base.hh"
+#include "params/CHAOSConvergence.hh"
+#include "sim/eventq.hh"
+#include "sim/probe/probe.hh"
+#include "sim/sim_object.hh"
+#include "sim/system.hh"
+#include "CHAOSCommon/injection_observer.hh"
+
+namespace gem5 {
+
+  // Golden-run state hashing. Every checkInterval cycles a digest of the
+  // architectural registers and of the memory written so far is computed.
+  // A golden run records the digests; a faulty run compares against them
+  // and ends the simulation as soon as its state matches the golden state
+  // again after an injection (the fault has been masked).
+  class CHAOSConvergence : public SimObject, public chaos::InjectionObserver {
+    public:
+      CHAOSConvergence(const CHAOSConvergenceParams &p);
+      ~CHAOSConvergence();
+
+      void regProbeListeners() override;
+      void startup() override;
+
+      void beforeCorruption(Addr addr, Addr size) override;
+      void faultInjected(bool permanent) override;
+      void faultInFlight(bool in_flight) override;
+
+    private:
+      struct GoldenRecord {
+        uint64_t tick;
+        uint64_t digest;
+      };
+
+      // Memory is hashed per cache block. Each written block contributes
+      // H(current) ^ H(value before its first write), so blocks that are
+      // restored contribute nothing and the digest only depends on the
+      // difference from the initial memory image.
+      struct BlockHash {
+        uint64_t base;
+        uint64_t current;
+        bool pending;
+      };
+
+      System *system;
+      bool record_golden;
+      std::string golden_file;
+      uint64_t check_interval;
+      int tick_to_clock_ratio;
+      unsigned block_size;
+
+      bool injected;
+      bool permanent_fault;
+      // Faults still held by in-flight instructions, invisible to the digest
+      int in_flight_faults;
+
+      EventFunctionWrapper checkEvent;
+      Tick check_ticks;
+
+      std::unordered_map<Addr, BlockHash> blocks;
+      std::vector<Addr> pending_blocks;
+      uint64_t mem_hash;
+      std::vector<uint8_t> block_buffer;
+
+      std::vector<GoldenRecord> golden;
+      size_t golden_cursor;
+      OutputStream *golden_stream;
+
+      std::vector<BaseCache *> caches;
+      std::vector<std::unique_ptr<ProbeListener>> listeners;
+
+      void trackBlock(Addr blk_addr, const uint8_t *old_data);
+      void notifyDataUpdate(const CacheDataUpdateProbeArg &arg);
+      uint64_t hashRegisters() const;
+      uint64_t computeDigest();
+      void check();
+
+      struct CHAOSConvergenceStats : public statistics::Group
+      {
+        statistics::Scalar numChecks;
+        statistics::Scalar numBlocksHashed;
+        statistics::Scalar numTrackedBlocks;
+        statistics::Scalar convergenceTick;
+
+        CHAOSConvergenceStats(statistics::Group *parent);
+      };
+
+      std::unique_ptr<CHAOSConvergenceStats> stats;
+  };
+
+} // namespace gem5
+
+#endif // __CHAOSCONVERGENCE_HH__
@@ -0,0 +1,15 @@
+from m5.params import *
+from m5.proxy import *
+from m5.SimObject import SimObject
+
+class CHAOSConvergence(SimObject):
+    type = 'CHAOSConvergence'
+    cxx_class = 'gem5::CHAOSConvergence'
+    cxx_header = "CHAOSConvergence/CHAOSConvergence.hh"
+
+    system = Param.System(Parent.any, "System whose state is hashed")
+    caches = VectorParam.BaseCache([], "L1 data caches, used to track the memory written by the CPUs")
+    goldenFile = Param.String("golden_hashes.bin", "File of golden state digests (written with recordGolden, read otherwise)")
+    recordGolden = Param.Bool(False, "Record the golden digests instead of comparing with them (fault-free run)")
+    checkInterval = Param.UInt64(100000, "Clock cycles between two state digests")
+    tickToClockRatio = Param.Int(1000, "Ratio between tick and clock cycle (tick/cycle)")
\ No newline at end of file
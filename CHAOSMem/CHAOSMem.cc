@@ -1,23 +1,30 @@
 #include "mem/CHAOSMem/CHAOSMem.hh"
 #include "params/CHAOSMem.hh"
 
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 #include <random>
 #include <bitset>
 #include <functional>
 #include <string>     
+#include <iomanip>
 
 #include "sim/sim_object.hh"
 #include "sim/eventq.hh"
 #include "mem/packet.hh"
 #include "mem/packet_access.hh"
+#include "CHAOSCommon/checkpoint.hh"
+#include "CHAOSCommon/mask_kernels.hh"
 
 namespace gem5 {
 
     CHAOSMem::CHAOSMem(const CHAOSMemParams& p)
     : SimObject(p), 
+    memory(p.mem),
     probability(p.probability), 
     num_bits_to_change(p.bitsToChange),
+    corruption_size(p.corruptionSize),
     first_clock(p.firstClock), 
     last_clock(p.lastClock),
     fault_type_enum(stringToFaultType(p.faultType)),
@@ -28,25 +35,42 @@ namespace gem5 {
     stuck_at_one_prob(p.stuckAtOneProb),
     cycles_permament_fault_check(p.cyclesPermamentFaultCheck),
     write_log(p.writeLog),
+    binary_log(p.logFormat == "binary"),
+    campaign_mode(p.campaignMode),
+    seed(p.seed),
+    experiment(p.experiment),
+    use_schedule(!p.faultSchedule.empty()),
+    fault_map_file(p.faultMap),
     target_start(p.addr_start), 
     target_end(p.addr_end),
+    target_selection(stringToTargetSelection(p.targetSelection)),
+    page_bytes(p.pageSize),
+    fault_model(stringToFaultModel(p.faultModel)),
     attackEvent([this]{ this->attackMemory(); }, name()),
     periodicCheck([this] { this->checkPermanent(); }, name() + ".periodicCheck"),
+    restored(false),
+    restored_attack_tick(MaxTick),
+    restored_check_tick(MaxTick),
+    cpuSidePort(name() + ".cpu_side_port", *this),
+    memSidePort(name() + ".mem_side_port", *this),
     stats(nullptr)
     {
-        if (probability > 0.0) {
-            if (p.mem) {
-                memory = p.mem;
+        if (probability > 0.0 || use_schedule || campaign_mode || !fault_map_file.empty()) {
+            if (seed == 0) {
+                seed = (uint64_t(rd()) << 32) | rd();
             }
+            seedRng();
 
-            if (!memory) {
+            if (!memory || memory->isNull()) {
                 warn("CHAOSMem: Memory not available. Disabling fault injection.\n");
+                memory = nullptr;
                 return;
             }
             
-            log_stream = simout.create("main_mem_injections.log", false, true);
-            if (!log_stream || !log_stream->stream()) {
-                panic("CHAOSMem: Could not open log file");
+            // In campaign mode the log is opened by startExperiment(), once
+            // the forked child has its own output directory.
+            if (!campaign_mode || use_schedule) {
+                openLog();
             }
             
             if (num_bits_to_change == -1){
@@ -71,15 +95,53 @@ namespace gem5 {
 
             target_size = target_end - target_start + 1;
 
+            if (corruption_size < 1 || Addr(corruption_size) > target_size) {
+                fatal("CHAOSMem: corruptionSize must be between 1 and the size of the target range.\n");
+            }
+            mask_buffer.resize(corruption_size);
+
+            if (fault_model != FaultModel::Bytes) {
+                auto *dram_interface = dynamic_cast<memory::DRAMInterface *>(memory);
+                if (!dram_interface) {
+                    fatal("CHAOSMem: faultModel=%s needs mem to be a DRAMInterface (e.g. the dram of a MemCtrl).\n",
+                          p.faultModel);
+                }
+                if (target_selection == TargetSelection::OnRead) {
+                    fatal("CHAOSMem: targetSelection on_read only supports faultModel=bytes.\n");
+                }
+                readDRAMGeometry(dram_interface);
+            }
+
+            if (target_selection != TargetSelection::Uniform) {
+                if (page_bytes == 0) {
+                    fatal("CHAOSMem: pageSize must be greater than 0.\n");
+                }
+                Addr num_pages = (target_size + page_bytes - 1) / page_bytes;
+                touched_bitmap.assign((num_pages + 63) / 64, 0);
+            }
+
             first_tick = first_clock * tick_to_clock_ratio;
             last_tick = last_clock * tick_to_clock_ratio;
 
             ticks_permament_fault_check = cycles_permament_fault_check * tick_to_clock_ratio;
 
-            rng.seed(rd());
-            inter_fault_tick_dist = std::geometric_distribution<unsigned>(probability);
-            
-            scheduleAttack(first_tick + inter_fault_tick_dist(rng) * tick_to_clock_ratio);
+            if (!fault_map_file.empty()) {
+                loadFaultMap();
+            }
+
+            if (use_schedule) {
+                // Faults come from the schedule file, no sampling takes place
+                fault_schedule.open(p.faultSchedule);
+                if (!fault_schedule.done()) {
+                    scheduleAttack(fault_schedule.peek().when);
+                }
+            } else if (probability > 0.0) {
+                inter_fault_tick_dist = std::geometric_distribution<unsigned>(probability);
+
+                if (!campaign_mode) {
+                    scheduleAttack(first_tick + inter_fault_tick_dist(rng) * tick_to_clock_ratio);
+                }
+            }
 
             if ((bit_flip_prob + stuck_at_zero_prob + stuck_at_one_prob) != 1.0){
                 warn("Sum of probabilities is not 1, assuming 0.9 for bitFlipProb, 0.05 for stuckAtZeroProb and 0.05 for stuckAtOneProb.\n");
@@ -90,8 +152,6 @@ namespace gem5 {
 
             std::vector<double> weights = {bit_flip_prob, bit_flip_prob, stuck_at_one_prob};
             random_fault_distribution = std::discrete_distribution<int>(weights.begin(), weights.end());
-
-            scheduleCheckPermanentFault(first_tick + ticks_permament_fault_check);
         }
     }
 
@@ -106,12 +166,555 @@ namespace gem5 {
       ADD_STAT(numStuckAtOne, statistics::units::Count::get(),
                "Number of stuck-at-1 faults injected"),
       ADD_STAT(numPermanentFaults, statistics::units::Count::get(),
-               "Total number of permanent faults injected")
+               "Total number of permanent faults injected"),
+      ADD_STAT(numArmedFaults, statistics::units::Count::get(),
+               "Number of faults armed, waiting for a read of their bytes"),
+      ADD_STAT(numSkippedFaults, statistics::units::Count::get(),
+               "Number of faults not injected because no page had been accessed yet"),
+      ADD_STAT(numDRAMBytesCorrupted, statistics::units::Byte::get(),
+               "Bytes covered by the row, column, bank and rank faults")
     {
     }
 
     CHAOSMem::~CHAOSMem() {}
 
+    void
+    CHAOSMem::init()
+    {
+        SimObject::init();
+
+        if (cpuSidePort.isConnected() != memSidePort.isConnected()) {
+            fatal("CHAOSMem: cpu_side_port and mem_side_port must both be connected to interpose on the memory access path.\n");
+        }
+
+        if (target_selection != TargetSelection::Uniform && !isInterposed()) {
+            fatal("CHAOSMem: targetSelection touched and on_read need the ports to be connected, accesses are observed on the shim.\n");
+        }
+    }
+
+    void
+    CHAOSMem::startup()
+    {
+        SimObject::startup();
+
+        if (isInjecting() && !isInterposed()) {
+            warn("CHAOSMem: not interposed on the memory access path, stuck-at faults fall back to periodic checks.\n");
+        }
+
+        if (restored) {
+            // The events scheduled by the constructor assumed a start at tick 0
+            chaos::restoreEvent(*this, attackEvent, restored_attack_tick);
+            chaos::restoreEvent(*this, periodicCheck, restored_check_tick);
+
+            // An experiment started before the checkpoint logs to this run
+            if (campaign_mode && !use_schedule && restored_attack_tick != MaxTick) {
+                openLog();
+            }
+        } else if (isInjecting() && !permanent_faults.empty()) {
+            // The imported cells are stuck from the start: the image loaded
+            // by initState() gets them before the first instruction
+            enforcePermanentFaults();
+            if (!isInterposed()) {
+                scheduleCheckPermanentFault(curTick() + ticks_permament_fault_check);
+            }
+        }
+    }
+
+    bool
+    CHAOSMem::isInjecting() const
+    {
+        return (probability > 0.0 || use_schedule || campaign_mode || !fault_map_file.empty()) && memory;
+    }
+
+    void
+    CHAOSMem::serialize(CheckpointOut &cp) const
+    {
+        bool injecting = isInjecting();
+        SERIALIZE_SCALAR(injecting);
+        if (!injecting)
+            return;
+
+        SERIALIZE_SCALAR(seed);
+        SERIALIZE_SCALAR(experiment);
+        SERIALIZE_SCALAR(num_bits_to_change);
+        chaos::serializeRng(cp, rng);
+        chaos::serializeEventTick(cp, "attackTick", attackEvent);
+        chaos::serializeEventTick(cp, "periodicCheckTick", periodicCheck);
+        if (use_schedule) {
+            paramOut(cp, "schedulePosition", fault_schedule.position());
+        }
+
+        // The overlay is saved chunk by chunk, imported cells included, as
+        // 64-bit words of its AND and OR masks
+        std::vector<Addr> fault_chunks;
+        std::vector<uint64_t> fault_and_masks;
+        std::vector<uint64_t> fault_or_masks;
+        permanent_faults.forEachChunk([&](Addr addr, const uint8_t *and_mask, const uint8_t *or_mask) {
+            fault_chunks.push_back(addr);
+            for (unsigned i = 0; i < chaos::FaultOverlay::chunkBytes; i += sizeof(uint64_t)) {
+                uint64_t word;
+                std::memcpy(&word, and_mask + i, sizeof(word));
+                fault_and_masks.push_back(word);
+                std::memcpy(&word, or_mask + i, sizeof(word));
+                fault_or_masks.push_back(word);
+            }
+        });
+        SERIALIZE_CONTAINER(fault_chunks);
+        SERIALIZE_CONTAINER(fault_and_masks);
+        SERIALIZE_CONTAINER(fault_or_masks);
+
+        // Stuck-at DRAM structures: their type, their extent as 7 words and
+        // their burst masks, back to back
+        std::vector<int> dram_fault_types;
+        std::vector<uint32_t> dram_fault_extents;
+        std::vector<unsigned> dram_fault_masks;
+        for (const DRAMFault &fault : dram_stuck_faults) {
+            dram_fault_types.push_back(int(fault.fault_type));
+            dram_fault_extents.insert(dram_fault_extents.end(),
+                {fault.rank, fault.bank_lo, fault.bank_hi, fault.row_lo,
+                 fault.row_hi, fault.col_lo, fault.col_hi});
+            dram_fault_masks.insert(dram_fault_masks.end(), fault.burst_mask.begin(), fault.burst_mask.end());
+        }
+        SERIALIZE_CONTAINER(dram_fault_types);
+        SERIALIZE_CONTAINER(dram_fault_extents);
+        SERIALIZE_CONTAINER(dram_fault_masks);
+
+        // The bitmap is rebuilt from the page list
+        SERIALIZE_CONTAINER(touched_pages);
+
+        std::vector<Addr> armed_addrs;
+        std::vector<int> armed_types;
+        std::vector<unsigned> armed_masks;
+        for (const auto &entry : armed_faults) {
+            armed_addrs.push_back(entry.first);
+            armed_types.push_back(int(entry.second.fault_type));
+            armed_masks.insert(armed_masks.end(), entry.second.masks.begin(), entry.second.masks.end());
+        }
+        SERIALIZE_CONTAINER(armed_addrs);
+        SERIALIZE_CONTAINER(armed_types);
+        SERIALIZE_CONTAINER(armed_masks);
+    }
+
+    void
+    CHAOSMem::unserialize(CheckpointIn &cp)
+    {
+        bool injecting;
+        UNSERIALIZE_SCALAR(injecting);
+        if (!injecting || !isInjecting()) {
+            if (injecting != isInjecting()) {
+                warn("CHAOSMem: injection enabled in only one of the checkpoint and the configuration, injector state not restored.\n");
+            }
+            return;
+        }
+
+        UNSERIALIZE_SCALAR(seed);
+        UNSERIALIZE_SCALAR(experiment);
+        UNSERIALIZE_SCALAR(num_bits_to_change);
+        chaos::unserializeRng(cp, rng);
+        restored_attack_tick = chaos::unserializeEventTick(cp, "attackTick");
+        restored_check_tick = chaos::unserializeEventTick(cp, "periodicCheckTick");
+        if (use_schedule) {
+            uint64_t position;
+            paramIn(cp, "schedulePosition", position);
+            fault_schedule.setPosition(position);
+        }
+
+        std::vector<Addr> fault_chunks;
+        std::vector<uint64_t> fault_and_masks;
+        std::vector<uint64_t> fault_or_masks;
+        UNSERIALIZE_CONTAINER(fault_chunks);
+        UNSERIALIZE_CONTAINER(fault_and_masks);
+        UNSERIALIZE_CONTAINER(fault_or_masks);
+        const size_t words = chaos::FaultOverlay::chunkBytes / sizeof(uint64_t);
+        if (fault_and_masks.size() != fault_chunks.size() * words ||
+            fault_or_masks.size() != fault_chunks.size() * words) {
+            fatal("CHAOSMem: the checkpoint holds inconsistent stuck-at masks.\n");
+        }
+        // The checkpoint replaces the fault map loaded by the constructor
+        permanent_faults.clear();
+        for (size_t i = 0; i < fault_chunks.size(); i++) {
+            permanent_faults.setChunk(fault_chunks[i],
+                reinterpret_cast<const uint8_t *>(&fault_and_masks[i * words]),
+                reinterpret_cast<const uint8_t *>(&fault_or_masks[i * words]));
+        }
+
+        std::vector<int> dram_fault_types;
+        std::vector<uint32_t> dram_fault_extents;
+        std::vector<unsigned> dram_fault_masks;
+        UNSERIALIZE_CONTAINER(dram_fault_types);
+        UNSERIALIZE_CONTAINER(dram_fault_extents);
+        UNSERIALIZE_CONTAINER(dram_fault_masks);
+        if (!dram_fault_types.empty() && fault_model == FaultModel::Bytes) {
+            fatal("CHAOSMem: the checkpoint holds DRAM faults, faultModel must not be bytes.\n");
+        }
+        if (dram_fault_extents.size() != dram_fault_types.size() * 7 ||
+            dram_fault_masks.size() != dram_fault_types.size() * dram.burst_size) {
+            fatal("CHAOSMem: the checkpoint was taken with a different DRAM geometry.\n");
+        }
+        dram_stuck_faults.clear();
+        for (size_t i = 0; i < dram_fault_types.size(); i++) {
+            const uint32_t *e = &dram_fault_extents[i * 7];
+            auto first = dram_fault_masks.begin() + i * dram.burst_size;
+            dram_stuck_faults.push_back({static_cast<FaultType>(dram_fault_types[i]),
+                                         e[0], e[1], e[2], e[3], e[4], e[5], e[6],
+                                         std::vector<uint8_t>(first, first + dram.burst_size)});
+        }
+
+        std::vector<uint32_t> pages;
+        arrayParamIn(cp, "touched_pages", pages);
+        touched_pages.clear();
+        std::fill(touched_bitmap.begin(), touched_bitmap.end(), 0);
+        if (!touched_bitmap.empty()) {
+            for (uint32_t page : pages) {
+                if (page / 64 < touched_bitmap.size()) {
+                    touched_bitmap[page / 64] |= uint64_t(1) << (page % 64);
+                    touched_pages.push_back(page);
+                }
+            }
+        }
+
+        std::vector<Addr> armed_addrs;
+        std::vector<int> armed_types;
+        std::vector<unsigned> armed_masks;
+        UNSERIALIZE_CONTAINER(armed_addrs);
+        UNSERIALIZE_CONTAINER(armed_types);
+        UNSERIALIZE_CONTAINER(armed_masks);
+        if (armed_masks.size() != armed_addrs.size() * corruption_size) {
+            fatal("CHAOSMem: the checkpoint was taken with a different corruptionSize.\n");
+        }
+        armed_faults.clear();
+        for (size_t i = 0; i < armed_addrs.size(); i++) {
+            auto first = armed_masks.begin() + i * corruption_size;
+            armed_faults[armed_addrs[i]] = {static_cast<FaultType>(armed_types[i]),
+                                            std::vector<uint8_t>(first, first + corruption_size)};
+        }
+
+        restored = true;
+    }
+
+    Port &
+    CHAOSMem::getPort(const std::string &if_name, PortID idx)
+    {
+        if (if_name == "cpu_side_port") {
+            return cpuSidePort;
+        } else if (if_name == "mem_side_port") {
+            return memSidePort;
+        }
+        return SimObject::getPort(if_name, idx);
+    }
+
+    bool
+    CHAOSMem::isInterposed() const
+    {
+        return cpuSidePort.isConnected() && memSidePort.isConnected();
+    }
+
+    AddrRangeList
+    CHAOSMem::CPUSidePort::getAddrRanges() const
+    {
+        return owner.memSidePort.getAddrRanges();
+    }
+
+    Tick
+    CHAOSMem::CPUSidePort::recvAtomic(PacketPtr pkt)
+    {
+        owner.observeAccess(pkt);
+
+        if (pkt->isWrite() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+
+        Tick latency = owner.memSidePort.sendAtomic(pkt);
+
+        if (pkt->isRead() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+
+        return latency;
+    }
+
+    Tick
+    CHAOSMem::CPUSidePort::recvAtomicBackdoor(PacketPtr pkt, MemBackdoorPtr &backdoor)
+    {
+        // Backdoors would let requestors bypass the shim, never hand them out.
+        return recvAtomic(pkt);
+    }
+
+    void
+    CHAOSMem::CPUSidePort::recvMemBackdoorReq(const MemBackdoorReq &req, MemBackdoorPtr &backdoor)
+    {
+        backdoor = nullptr;
+    }
+
+    void
+    CHAOSMem::CPUSidePort::recvFunctional(PacketPtr pkt)
+    {
+        owner.observeAccess(pkt);
+
+        if (pkt->isWrite() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+
+        owner.memSidePort.sendFunctional(pkt);
+
+        if (pkt->isRead() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+    }
+
+    bool
+    CHAOSMem::CPUSidePort::recvTimingReq(PacketPtr pkt)
+    {
+        owner.observeAccess(pkt);
+
+        if (pkt->isWrite() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+
+        return owner.memSidePort.sendTimingReq(pkt);
+    }
+
+    bool
+    CHAOSMem::CPUSidePort::tryTiming(PacketPtr pkt)
+    {
+        return owner.memSidePort.tryTiming(pkt);
+    }
+
+    void
+    CHAOSMem::CPUSidePort::recvRespRetry()
+    {
+        owner.memSidePort.sendRetryResp();
+    }
+
+    bool
+    CHAOSMem::MemSidePort::recvTimingResp(PacketPtr pkt)
+    {
+        // Reads are masked as well, so data forwarded from the controller
+        // write queue still observes the stuck bits.
+        if (pkt->isRead() && pkt->hasData())
+            owner.applyPermanentFaults(pkt);
+
+        return owner.cpuSidePort.sendTimingResp(pkt);
+    }
+
+    void
+    CHAOSMem::MemSidePort::recvReqRetry()
+    {
+        owner.cpuSidePort.sendRetryReq();
+    }
+
+    void
+    CHAOSMem::MemSidePort::recvRangeChange()
+    {
+        owner.cpuSidePort.sendRangeChange();
+    }
+
+    bool
+    CHAOSMem::hasPermanentFaults() const
+    {
+        return !permanent_faults.empty() || !dram_stuck_faults.empty();
+    }
+
+    void
+    CHAOSMem::applyPermanentFaults(PacketPtr pkt)
+    {
+        // One page lookup, then the AND/OR masks of the faulty chunks
+        if (!permanent_faults.empty()) {
+            permanent_faults.apply(pkt->getAddr(), pkt->getPtr<uint8_t>(), pkt->getSize());
+        }
+
+        if (!dram_stuck_faults.empty()) {
+            applyDRAMFaults(pkt->getAddr(), pkt->getPtr<uint8_t>(), pkt->getSize());
+        }
+    }
+
+    void
+    CHAOSMem::applyDRAMFaults(Addr addr, uint8_t *data, Addr size) const
+    {
+        // Only the target range was corrupted
+        Addr lo = std::max(addr, target_start);
+        Addr hi = std::min(addr + size, target_end + 1);
+
+        // Each burst of the access is decoded once and checked against the
+        // stuck structures, in injection order
+        for (Addr burst = lo - lo % dram.burst_size; burst < hi; burst += dram.burst_size) {
+            DRAMCoord coord = decodeDRAM(burst);
+            Addr from = std::max(burst, lo);
+            Addr to = std::min<Addr>(burst + dram.burst_size, hi);
+            for (const DRAMFault &fault : dram_stuck_faults) {
+                if (fault.covers(coord)) {
+                    chaos::applyMask(data + (from - addr), fault.burst_mask.data() + (from - burst), to - from,
+                                     fault.fault_type == FaultType::StuckAtZero ? chaos::MaskOp::Clear
+                                                                                : chaos::MaskOp::Set);
+                }
+            }
+        }
+    }
+
+    void
+    CHAOSMem::observeAccess(PacketPtr pkt)
+    {
+        // Requests are seen before the memory answers them: a read has no
+        // data yet, so accesses are recognised by their command
+        if (touched_bitmap.empty() || !(pkt->isRead() || pkt->isWrite()) || pkt->getSize() == 0)
+            return;
+
+        Addr start = std::max(pkt->getAddr(), target_start);
+        Addr end = std::min(pkt->getAddr() + pkt->getSize() - 1, target_end);
+        if (start > end)
+            return;
+
+        for (Addr page = (start - target_start) / page_bytes;
+             page <= (end - target_start) / page_bytes; page++) {
+            uint64_t bit = uint64_t(1) << (page % 64);
+            if (!(touched_bitmap[page / 64] & bit)) {
+                touched_bitmap[page / 64] |= bit;
+                touched_pages.push_back(page);
+            }
+        }
+
+        // The read has not reached the memory yet, it will return the
+        // corrupted bytes
+        if (pkt->isRead() && !armed_faults.empty()) {
+            triggerArmedFaults(pkt->getAddr(), pkt->getAddr() + pkt->getSize());
+        }
+    }
+
+    void
+    CHAOSMem::triggerArmedFaults(Addr start, Addr end)
+    {
+        // Armed regions are at most corruption_size bytes long
+        Addr first = (start >= Addr(corruption_size)) ? start - corruption_size + 1 : 0;
+        auto it = armed_faults.lower_bound(first);
+
+        while (it != armed_faults.end() && it->first < end) {
+            if (it->first + it->second.masks.size() <= start) {
+                ++it;
+                continue;
+            }
+            corruptRegion(it->first, it->second.masks.data(), it->second.masks.size(), it->second.fault_type);
+            it = armed_faults.erase(it);
+        }
+    }
+
+    bool
+    CHAOSMem::pickTarget(Addr &target_addr)
+    {
+        if (target_selection == TargetSelection::Uniform) {
+            // target_end is inclusive: the last region ends on it
+            std::uniform_int_distribution<Addr> dist(target_start, target_end - corruption_size + 1);
+            target_addr = dist(rng);
+            return true;
+        }
+
+        if (touched_pages.empty())
+            return false;
+
+        // Uniform over the touched pages, then over the page. A region
+        // longer than the page starts at the beginning of the page.
+        uint32_t page = touched_pages[std::uniform_int_distribution<size_t>(0, touched_pages.size() - 1)(rng)];
+        Addr page_start = target_start + Addr(page) * page_bytes;
+        Addr page_end = std::min(page_start + page_bytes - 1, target_end);
+        Addr last_start = std::min(page_end, target_end - corruption_size + 1);
+        if (last_start < page_start) {
+            last_start = page_start;
+        }
+
+        target_addr = std::uniform_int_distribution<Addr>(page_start, last_start)(rng);
+        return true;
+    }
+
+    CHAOSMem::TargetSelection
+    CHAOSMem::stringToTargetSelection(const std::string &s) {
+        if (s == "touched") return TargetSelection::Touched;
+        else if (s == "on_read") return TargetSelection::OnRead;
+        return TargetSelection::Uniform;
+    }
+
+    CHAOSMem::FaultModel
+    CHAOSMem::stringToFaultModel(const std::string &s) {
+        if (s == "row") return FaultModel::Row;
+        else if (s == "column") return FaultModel::Column;
+        else if (s == "bank") return FaultModel::Bank;
+        else if (s == "rank") return FaultModel::Rank;
+        else if (s != "bytes")
+            fatal("CHAOSMem: unknown faultModel '%s'\n", s);
+        return FaultModel::Bytes;
+    }
+
+    const char *
+    CHAOSMem::faultModelName(FaultModel m) {
+        switch (m) {
+            case FaultModel::Row: return "row";
+            case FaultModel::Column: return "column";
+            case FaultModel::Bank: return "bank";
+            case FaultModel::Rank: return "rank";
+            default: return "bytes";
+        }
+    }
+
+    void
+    CHAOSMem::readDRAMGeometry(memory::DRAMInterface *dram_interface)
+    {
+        struct DRAMAccessor : public memory::DRAMInterface {
+            void geometry(DRAMGeometry &g) const {
+                g = {range, burstSize, burstsPerRowBuffer, burstsPerStripe,
+                     ranksPerChannel, banksPerRank, rowsPerBank, addrMapping};
+            }
+        };
+
+        static_cast<DRAMAccessor *>(dram_interface)->geometry(dram);
+        dram_mask.resize(dram.bursts_per_row * dram.burst_size);
+    }
+
+    CHAOSMem::DRAMCoord
+    CHAOSMem::decodeDRAM(Addr addr) const
+    {
+        // Same decoding as MemInterface::decodePacket(), keeping the column
+        // (burst index in the row) it drops
+        Addr burst = dram.range.getOffset(addr) / dram.burst_size;
+        DRAMCoord coord;
+        if (dram.mapping == enums::RoCoRaBaCh && dram.bursts_per_stripe < dram.bursts_per_row) {
+            // The low column bits are below the bank bits, the high ones
+            // above the rank bits
+            uint32_t column_low = burst % dram.bursts_per_stripe;
+            burst /= dram.bursts_per_stripe;
+            coord.bank = burst % dram.banks;
+            burst /= dram.banks;
+            coord.rank = burst % dram.ranks;
+            burst /= dram.ranks;
+            uint32_t stripes_per_row = dram.bursts_per_row / dram.bursts_per_stripe;
+            coord.column = (burst % stripes_per_row) * dram.bursts_per_stripe + column_low;
+            burst /= stripes_per_row;
+        } else {
+            coord.column = burst % dram.bursts_per_row;
+            burst /= dram.bursts_per_row;
+            coord.bank = burst % dram.banks;
+            burst /= dram.banks;
+            coord.rank = burst % dram.ranks;
+            burst /= dram.ranks;
+        }
+        coord.row = burst % dram.rows;
+        return coord;
+    }
+
+    Addr
+    CHAOSMem::encodeDRAM(const DRAMCoord &coord) const
+    {
+        Addr burst;
+        if (dram.mapping == enums::RoCoRaBaCh && dram.bursts_per_stripe < dram.bursts_per_row) {
+            uint32_t stripes_per_row = dram.bursts_per_row / dram.bursts_per_stripe;
+            burst = Addr(coord.row) * stripes_per_row + coord.column / dram.bursts_per_stripe;
+            burst = (burst * dram.ranks + coord.rank) * dram.banks + coord.bank;
+            burst = burst * dram.bursts_per_stripe + coord.column % dram.bursts_per_stripe;
+        } else {
+            burst = (Addr(coord.row) * dram.ranks + coord.rank) * dram.banks + coord.bank;
+            burst = burst * dram.bursts_per_row + coord.column;
+        }
+
+        // Back from the controller address space, channel bits included
+        Addr offset = burst * dram.burst_size;
+        if (dram.range.interleaved()) {
+            return dram.range.addIntlvBits(offset + dram.range.removeIntlvBits(dram.range.start()));
+        }
+        return dram.range.start() + offset;
+    }
+
     CHAOSMem::FaultType 
     CHAOSMem::stringToFaultType(const std::string &s) {
         if (s == "bit_flip") return FaultType::BitFlip;
@@ -130,6 +733,61 @@ namespace gem5 {
         return "random";
     }
 
+    void
+    CHAOSMem::seedRng()
+    {
+        // Instances sharing the same seed still get independent keys
+        rng.seed(seed ^ chaos::Philox::hashName(name()), experiment);
+        inform("%s: seed %llu, experiment %llu\n", name(), seed, experiment);
+    }
+
+    void
+    CHAOSMem::openLog()
+    {
+        if (binary_log) {
+            bin_log.open(simout.resolve("main_mem_injections.bin"), {memory->name()});
+            return;
+        }
+
+        log_stream = simout.create("main_mem_injections.log", false, true);
+        if (!log_stream || !log_stream->stream()) {
+            panic("CHAOSMem: Could not open log file");
+        }
+    }
+
+    void
+    CHAOSMem::startExperiment(uint64_t experiment)
+    {
+        if (probability <= 0.0 || !campaign_mode || !memory || use_schedule)
+            return;
+
+        openLog();
+
+        this->experiment = experiment;
+        seedRng();
+
+        scheduleAttack(std::max(curTick(), first_tick) + inter_fault_tick_dist(rng) * tick_to_clock_ratio);
+    }
+
+    void
+    CHAOSMem::armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                       uint32_t fault_type, uint64_t mask)
+    {
+        if (!campaign_mode || !memory || fault_schedule.isOpen()) {
+            warn("CHAOSMem: armFault() needs campaignMode and no faultSchedule, fault ignored.\n");
+            return;
+        }
+
+        // The first armed fault turns the injector into an in-memory schedule
+        if (!use_schedule) {
+            openLog();
+            use_schedule = true;
+        }
+
+        fault_schedule.append({when, target, target2, uint16_t(target3), uint8_t(fault_type), 0, mask});
+        scheduleAttack(std::max(Tick(fault_schedule.peek().when), curTick()));
+    }
+
     void 
     CHAOSMem::scheduleAttack(Tick time) {
         if (!attackEvent.scheduled()) {
@@ -146,7 +804,7 @@ namespace gem5 {
     }
 
     unsigned char 
-    CHAOSMem::generateRandomMask(std::mt19937 &rng, int bits_to_change, int len)
+    CHAOSMem::generateRandomMask(chaos::Philox &rng, int bits_to_change, int len)
     {
         unsigned char mask = 0;
         std::uniform_int_distribution<int> bitDist(0, len-1);
@@ -159,25 +817,26 @@ namespace gem5 {
 
     void 
     CHAOSMem::attackMemory() {
+        if (use_schedule) {
+            injectScheduled();
+            return;
+        }
+
         if (!memory) {
             warn("CHAOSMem: Memory not available.\n");
             scheduleAttack(curTick() + inter_fault_tick_dist(rng) * tick_to_clock_ratio);
             return;
         }
 
-        std::uniform_int_distribution<Addr> dist(target_start, target_end - 1);
-        Addr target_addr = dist(rng);
-
-        try {
-            // Attack a single byte
-            uint8_t data;
-            RequestPtr req = std::make_shared<Request>(target_addr, sizeof(data), 0, 0);
-            PacketPtr read_pkt = new Packet(req, MemCmd::ReadReq);
-            read_pkt->dataStatic(&data);
-
-            memory->access(read_pkt);
-
-            unsigned char mask = (fault_mask != 0) ? fault_mask : generateRandomMask(rng, num_bits_to_change, sizeof(data) << 3);
+        Addr target_addr;
+        if (pickTarget(target_addr)) {
+            // A DRAM fault repeats one burst-wide mask over its structure
+            bool dram_fault = fault_model != FaultModel::Bytes;
+            uint8_t *masks = dram_fault ? dram_mask.data() : mask_buffer.data();
+            int mask_bytes = dram_fault ? int(dram.burst_size) : corruption_size;
+            for (int i = 0; i < mask_bytes; i++) {
+                masks[i] = (fault_mask != 0) ? fault_mask : generateRandomMask(rng, num_bits_to_change, 8);
+            }
 
             FaultType chosen_fault_type_enum = fault_type_enum;
             if (fault_type_enum == FaultType::Random) {
@@ -185,53 +844,18 @@ namespace gem5 {
                 chosen_fault_type_enum = static_cast<FaultType>(faultIdx);
             }
 
-            switch (chosen_fault_type_enum) {
-                case FaultType::StuckAtZero:
-                    data &= ~mask;
-                    stats->numStuckAtZero++;
-                    stats->numPermanentFaults++;
-                    permanent_faults[target_addr] = {chosen_fault_type_enum, mask, true};
-                    break;
-                case FaultType::StuckAtOne:
-                    data |= mask;
-                    stats->numStuckAtOne++;
-                    stats->numPermanentFaults++;
-                    permanent_faults[target_addr] = {chosen_fault_type_enum, mask, true};
-                    break;
-                case FaultType::BitFlip:
-                    data ^= mask;
-                    stats->numBitFlips++;
-                    break;
-                default:
-                    break;
-            }
-
-            PacketPtr write_pkt = new Packet(req, MemCmd::WriteReq);
-            write_pkt->dataStatic(&data);
-
-            memory->access(write_pkt);
-            stats->numFaultsInjected++;
-
-            delete read_pkt;
-            delete write_pkt;
-
-            if (write_log){
-                *(log_stream->stream()) << "Tick: " << curTick() 
-                    << ", target addr: " << target_addr
-                    << ", Mask: " << std::bitset<8>(mask)
-                    << ", Fault Type: " << faultTypeToString(chosen_fault_type_enum)
-                    << std::dec << std::endl;
-            }
-
-        } catch (const std::exception &e) {
-            *(log_stream->stream())  << "Error: Exception during fault injection. "
-                    << "Target Addr: " << target_addr
-                    << ", Error: " << e.what() << std::endl;
-        } catch (...) {
-            *(log_stream->stream())  << "Error: Unknown exception during fault injection. "
-                    << "Target Addr: " << target_addr << std::endl;
-        }
-        
+            if (dram_fault) {
+                corruptDRAM(target_addr, chosen_fault_type_enum);
+            } else if (target_selection == TargetSelection::OnRead) {
+                armed_faults[target_addr] = {chosen_fault_type_enum, mask_buffer};
+                stats->numArmedFaults++;
+            } else {
+                corruptRegion(target_addr, mask_buffer.data(), corruption_size, chosen_fault_type_enum);
+            }
+        } else {
+            stats->numSkippedFaults++;
+        }
+
         Tick next_injection = curTick() + inter_fault_tick_dist(rng) * tick_to_clock_ratio;
 
         if (next_injection <= last_tick || last_tick == 0) {
@@ -239,51 +863,306 @@ namespace gem5 {
         }
     }
 
-    void CHAOSMem::checkPermanent()
+    void
+    CHAOSMem::corruptRegion(Addr target_addr, const uint8_t *masks, int size, FaultType fault_type)
     {
-        for (auto &entry : permanent_faults) {
-            if (!entry.second.update)
-                continue;
+        chaos::notifyBeforeCorruption(target_addr, size);
+
+        // Corrupt the backing store in place, no request or packet is needed
+        uint8_t *data = memory->toHostAddr(target_addr);
+
+        switch (fault_type) {
+            case FaultType::StuckAtZero:
+                chaos::applyMask(data, masks, size, chaos::MaskOp::Clear);
+                stats->numStuckAtZero++;
+                stats->numPermanentFaults++;
+                addPermanentFaults(target_addr, masks, size, fault_type);
+                break;
+            case FaultType::StuckAtOne:
+                chaos::applyMask(data, masks, size, chaos::MaskOp::Set);
+                stats->numStuckAtOne++;
+                stats->numPermanentFaults++;
+                addPermanentFaults(target_addr, masks, size, fault_type);
+                break;
+            case FaultType::BitFlip:
+                chaos::applyMask(data, masks, size, chaos::MaskOp::Xor);
+                stats->numBitFlips++;
+                break;
+            default:
+                break;
+        }
+
+        stats->numFaultsInjected++;
+        chaos::notifyFaultInjected(fault_type != FaultType::BitFlip);
+
+        if (hasPermanentFaults() && !isInterposed()) {
+            scheduleCheckPermanentFault(curTick() + ticks_permament_fault_check);
+        }
+
+        if (write_log && binary_log) {
+            // The first 8 mask bytes travel in the record, the rest in
+            // MemMask continuation records
+            for (int i = 0; i < size; i += sizeof(uint64_t)) {
+                uint64_t chunk = 0;
+                std::memcpy(&chunk, masks + i, std::min<size_t>(sizeof(chunk), size - i));
+                if (i == 0) {
+                    bin_log.append({curTick(), target_addr, chunk, uint32_t(size), 0,
+                                    chaos::LogKind::Mem, uint8_t(fault_type)});
+                } else {
+                    bin_log.append({curTick(), target_addr + i, chunk, 0, 0,
+                                    chaos::LogKind::MemMask, uint8_t(fault_type)});
+                }
+            }
+        } else if (write_log){
+            std::ostream &os = *(log_stream->stream());
+            os << "Tick: " << curTick()
+                << ", target addr: " << target_addr;
+            if (size == 1) {
+                os << ", Mask: " << std::bitset<8>(masks[0]);
+            } else {
+                os << ", Size: " << size << ", Mask: " << std::hex;
+                for (int i = 0; i < size; i++) {
+                    os << std::setw(2) << std::setfill('0') << unsigned(masks[i]);
+                }
+            }
+            os << ", Fault Type: " << faultTypeToString(fault_type)
+                << std::dec << std::endl;
+        }
+    }
+
+    void
+    CHAOSMem::corruptDRAM(Addr target_addr, FaultType fault_type)
+    {
+        DRAMCoord hit = decodeDRAM(target_addr);
+
+        // The burst mask is tiled over a whole row, so contiguous bursts
+        // are corrupted in a few long passes
+        for (uint32_t b = 1; b < dram.bursts_per_row; b++) {
+            std::memcpy(dram_mask.data() + b * dram.burst_size, dram_mask.data(), dram.burst_size);
+        }
+
+        // Banks, rows and columns covered by the fault, in the rank hit
+        DRAMFault fault = {fault_type, hit.rank, hit.bank, hit.bank + 1,
+                           hit.row, hit.row + 1, hit.column, hit.column + 1, {}};
+        switch (fault_model) {
+            case FaultModel::Rank:
+                fault.bank_lo = 0;
+                fault.bank_hi = dram.banks;
+                [[fallthrough]];
+            case FaultModel::Bank:
+                fault.col_lo = 0;
+                fault.col_hi = dram.bursts_per_row;
+                [[fallthrough]];
+            case FaultModel::Column:
+                fault.row_lo = 0;
+                fault.row_hi = dram.rows;
+                break;
+            default:
+                fault.col_lo = 0;
+                fault.col_hi = dram.bursts_per_row;
+                break;
+        }
+
+        chaos::MaskOp op = chaos::MaskOp::Xor;
+        if (fault_type == FaultType::StuckAtZero) {
+            op = chaos::MaskOp::Clear;
+        } else if (fault_type == FaultType::StuckAtOne) {
+            op = chaos::MaskOp::Set;
+        }
+
+        Addr bytes = 0;
+        forEachDRAMRun(fault, [&](Addr run_start, Addr run_end) {
+            bytes += corruptRun(run_start, run_end, op, true);
+        });
+
+        // A stuck structure is kept whole, not as per-byte overlay masks
+        if (op != chaos::MaskOp::Xor) {
+            fault.burst_mask.assign(dram_mask.begin(), dram_mask.begin() + dram.burst_size);
+            dram_stuck_faults.push_back(std::move(fault));
+        }
+
+        switch (fault_type) {
+            case FaultType::StuckAtZero:
+                stats->numStuckAtZero++;
+                stats->numPermanentFaults++;
+                break;
+            case FaultType::StuckAtOne:
+                stats->numStuckAtOne++;
+                stats->numPermanentFaults++;
+                break;
+            case FaultType::BitFlip:
+                stats->numBitFlips++;
+                break;
+            default:
+                break;
+        }
+
+        stats->numFaultsInjected++;
+        stats->numDRAMBytesCorrupted += bytes;
+        chaos::notifyFaultInjected(fault_type != FaultType::BitFlip);
+
+        if (hasPermanentFaults() && !isInterposed()) {
+            scheduleCheckPermanentFault(curTick() + ticks_permament_fault_check);
+        }
+
+        if (write_log && binary_log) {
+            // One record for the whole structure, the burst mask continues
+            // in MemMask records
+            for (unsigned i = 0; i < dram.burst_size; i += sizeof(uint64_t)) {
+                uint64_t chunk = 0;
+                std::memcpy(&chunk, dram_mask.data() + i, std::min<size_t>(sizeof(chunk), dram.burst_size - i));
+                if (i == 0) {
+                    bin_log.append({curTick(), (uint64_t(hit.row) << 32) | hit.column, chunk,
+                                    (hit.rank << 16) | hit.bank, uint16_t(fault_model),
+                                    chaos::LogKind::DRAM, uint8_t(fault_type)});
+                } else {
+                    bin_log.append({curTick(), 0, chunk, 0, 0, chaos::LogKind::MemMask, uint8_t(fault_type)});
+                }
+            }
+        } else if (write_log) {
+            std::ostream &os = *(log_stream->stream());
+            os << "Tick: " << curTick()
+                << ", DRAM Fault: " << faultModelName(fault_model)
+                << ", Rank: " << hit.rank
+                << ", Bank: " << hit.bank
+                << ", Row: " << hit.row
+                << ", Column: " << hit.column
+                << ", Mask: " << std::hex;
+            for (unsigned i = 0; i < dram.burst_size; i++) {
+                os << std::setw(2) << std::setfill('0') << unsigned(dram_mask[i]);
+            }
+            os << std::dec << ", Fault Type: " << faultTypeToString(fault_type) << std::endl;
+        }
+    }
 
-            Addr target_addr = entry.first;
-            const PermanentFault &fault = entry.second;
-
-            try {
-                uint8_t data;
-                RequestPtr req = std::make_shared<Request>(target_addr, sizeof(uint8_t), 0, 0);
-                PacketPtr read_pkt = new Packet(req, MemCmd::ReadReq);
-                read_pkt->dataStatic(&data);
-
-                memory->access(read_pkt);
-
-                switch (fault.fault_type) {
-                    case FaultType::StuckAtZero:
-                        data &= ~fault.mask;
-                        break;
-                    case FaultType::StuckAtOne:
-                        data |= fault.mask;
-                        break;
-                    default:
-                        break;
+    void
+    CHAOSMem::forEachDRAMRun(const DRAMFault &fault, const std::function<void(Addr, Addr)> &fn) const
+    {
+        // Bursts adjacent in the address space are merged into runs
+        Addr run_start = 0, run_end = 0;
+        for (uint32_t bank = fault.bank_lo; bank < fault.bank_hi; bank++) {
+            for (uint32_t row = fault.row_lo; row < fault.row_hi; row++) {
+                for (uint32_t column = fault.col_lo; column < fault.col_hi; column++) {
+                    Addr addr = encodeDRAM({fault.rank, bank, row, column});
+                    if (addr != run_end) {
+                        if (run_end != run_start) {
+                            fn(run_start, run_end);
+                        }
+                        run_start = addr;
+                    }
+                    run_end = addr + dram.burst_size;
                 }
+            }
+        }
+        if (run_end != run_start) {
+            fn(run_start, run_end);
+        }
+    }
 
-                PacketPtr write_pkt = new Packet(req, MemCmd::WriteReq);
-                write_pkt->dataStatic(&data);
+    Addr
+    CHAOSMem::corruptRun(Addr run_start, Addr run_end, chaos::MaskOp op, bool notify)
+    {
+        // Only the part inside the target range is corrupted
+        Addr lo = std::max(run_start, target_start);
+        Addr hi = std::min(run_end, target_end + 1);
+        if (lo >= hi)
+            return 0;
+
+        if (notify) {
+            chaos::notifyBeforeCorruption(lo, hi - lo);
+        }
 
-                memory->access(write_pkt);
-                entry.second.update = false;
+        for (Addr addr = lo; addr < hi;) {
+            // Runs start on a burst, so the tiled mask lines up with each one
+            Addr offset = (addr - run_start) % dram.burst_size;
+            Addr len = std::min<Addr>(hi - addr, dram_mask.size() - offset);
+            chaos::applyMask(memory->toHostAddr(addr), dram_mask.data() + offset, len, op);
+            addr += len;
+        }
+        return hi - lo;
+    }
 
-                delete read_pkt;
-                delete write_pkt;
-            } catch (const std::exception &e) {
-                *(log_stream->stream())  << "Error: Exception during fault injection. "
-                        << "Target Addr: " << target_addr
-                        << ", Error: " << e.what() << std::endl;
-            } catch (...) {
-                *(log_stream->stream())  << "Error: Unknown exception during fault injection. "
-                        << "Target Addr: " << target_addr << std::endl;
+    void
+    CHAOSMem::injectScheduled()
+    {
+        while (!fault_schedule.done() && fault_schedule.peek().when <= curTick()) {
+            const chaos::FaultRecord &record = fault_schedule.next();
+
+            // The 64-bit mask covers the 8 bytes starting at target
+            uint8_t masks[sizeof(record.mask)];
+            for (size_t i = 0; i < sizeof(masks); i++) {
+                masks[i] = uint8_t(record.mask >> (8 * i));
             }
+
+            int size = sizeof(masks);
+            while (size > 0 && masks[size - 1] == 0) {
+                size--;
+            }
+
+            if (size == 0 || record.target < target_start || record.target + size - 1 > target_end ||
+                record.fault_type > uint8_t(FaultType::StuckAtOne)) {
+                warn("CHAOSMem: skipping invalid scheduled fault at %#x\n", record.target);
+                continue;
+            }
+
+            corruptRegion(record.target, masks, size, static_cast<FaultType>(record.fault_type));
         }
+
+        if (!fault_schedule.done()) {
+            scheduleAttack(fault_schedule.peek().when);
+        }
+    }
+
+    void
+    CHAOSMem::addPermanentFaults(Addr target_addr, const uint8_t *masks, int size, FaultType fault_type)
+    {
+        permanent_faults.add(target_addr, masks, size,
+                             fault_type == FaultType::StuckAtZero ? chaos::MaskOp::Clear : chaos::MaskOp::Set);
+    }
+
+    void
+    CHAOSMem::loadFaultMap()
+    {
+        uint64_t skipped;
+        uint64_t loaded = permanent_faults.load(fault_map_file, target_start, target_end, skipped);
+        if (skipped) {
+            warn("CHAOSMem: %llu fault map records outside the target range or not stuck-at, ignored.\n", skipped);
+        }
+        inform("CHAOSMem: %llu stuck-at records loaded from %s (%llu chunks of %d bytes)\n",
+               loaded, fault_map_file, permanent_faults.numChunks(), chaos::FaultOverlay::chunkBytes);
+    }
+
+    void
+    CHAOSMem::enforcePermanentFaults()
+    {
+        // Stuck bytes are all in the target range, only the padding of a
+        // chunk (no stuck bit) can fall outside the memory
+        const AddrRange &range = memory->getAddrRange();
+        permanent_faults.forEachChunk([&](Addr addr, const uint8_t *and_mask, const uint8_t *or_mask) {
+            Addr lo = std::max(addr, range.start());
+            Addr hi = std::min(addr + chaos::FaultOverlay::chunkBytes, range.end());
+            chaos::applyStuckMasks(memory->toHostAddr(lo), and_mask + (lo - addr),
+                                   or_mask + (lo - addr), hi - lo);
+        });
+
+        // Stuck DRAM structures are walked again, with their burst mask
+        // tiled over a row
+        for (const DRAMFault &fault : dram_stuck_faults) {
+            for (uint32_t b = 0; b < dram.bursts_per_row; b++) {
+                std::copy(fault.burst_mask.begin(), fault.burst_mask.end(), dram_mask.begin() + b * dram.burst_size);
+            }
+            chaos::MaskOp op = fault.fault_type == FaultType::StuckAtZero ? chaos::MaskOp::Clear : chaos::MaskOp::Set;
+            forEachDRAMRun(fault, [&](Addr run_start, Addr run_end) {
+                corruptRun(run_start, run_end, op, false);
+            });
+        }
+    }
+
+    void CHAOSMem::checkPermanent()
+    {
+        // Fallback used when CHAOSMem is not interposed on the access path:
+        // every stuck cell is re-applied, since any write may have cleared it.
+        enforcePermanentFaults();
         scheduleCheckPermanentFault(curTick() + ticks_permament_fault_check);
     }
 
@@ -6,15 +6,25 @@
 #include <string>
 #include <cstdint>
 #include <functional>
+#include <map>
+#include <vector>
 
 #include "sim/sim_object.hh"
 #include "mem/abstract_mem.hh"
+#include "mem/dram_interface.hh"
+#include "enums/AddrMap.hh"
 #include "sim/eventq.hh"
 #include "base/types.hh"
 #include "params/CHAOSMem.hh"
 #include "mem/packet.hh"
+#include "mem/port.hh"
 #include <stdexcept>
 #include "base/output.hh"
+#include "CHAOSCommon/binary_log.hh"
+#include "CHAOSCommon/fault_overlay.hh"
+#include "CHAOSCommon/fault_schedule.hh"
+#include "CHAOSCommon/injection_observer.hh"
+#include "CHAOSCommon/philox.hh"
 
 namespace gem5 {
 
@@ -23,18 +33,125 @@ namespace gem5 {
       CHAOSMem(const CHAOSMemParams& p);
       ~CHAOSMem();
 
+      void init() override;
+      void startup() override;
+      void serialize(CheckpointOut &cp) const override;
+      void unserialize(CheckpointIn &cp) override;
+      Port &getPort(const std::string &if_name, PortID idx=InvalidPortID) override;
+
+      // Campaign mode: arm the injector for experiment 'experiment' from the
+      // current tick, with an RNG stream of its own (called after a fork).
+      void startExperiment(uint64_t experiment);
+
+      // Campaign mode: inject the given fault (a fault schedule record,
+      // see CHAOSCommon/fault_schedule.hh) at 'when'. Faults armed in the
+      // same run must be given in time order.
+      void armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                    uint32_t fault_type, uint64_t mask);
+
     private:
+      // Optional pass-through shim placed between the memory bus and the
+      // memory controller. When connected, stuck-at faults are enforced on
+      // the bytes each packet touches instead of by a periodic event.
+      class CPUSidePort : public ResponsePort
+      {
+        private:
+          CHAOSMem &owner;
+
+        public:
+          CPUSidePort(const std::string &name, CHAOSMem &owner)
+            : ResponsePort(name), owner(owner)
+          {}
+
+        protected:
+          AddrRangeList getAddrRanges() const override;
+          Tick recvAtomic(PacketPtr pkt) override;
+          Tick recvAtomicBackdoor(PacketPtr pkt, MemBackdoorPtr &backdoor) override;
+          void recvMemBackdoorReq(const MemBackdoorReq &req, MemBackdoorPtr &backdoor) override;
+          void recvFunctional(PacketPtr pkt) override;
+          bool recvTimingReq(PacketPtr pkt) override;
+          bool tryTiming(PacketPtr pkt) override;
+          void recvRespRetry() override;
+      };
+
+      class MemSidePort : public RequestPort
+      {
+        private:
+          CHAOSMem &owner;
+
+        public:
+          MemSidePort(const std::string &name, CHAOSMem &owner)
+            : RequestPort(name), owner(owner)
+          {}
+
+        protected:
+          bool recvTimingResp(PacketPtr pkt) override;
+          void recvReqRetry() override;
+          void recvRangeChange() override;
+      };
+
       enum class FaultType {
           BitFlip,
           StuckAtZero,
           StuckAtOne,
           Random
       };
-      
-      struct PermanentFault {
+
+      // How the target address of a sampled fault is chosen
+      enum class TargetSelection {
+          Uniform,  // anywhere in [addr_start, addr_end]
+          Touched,  // inside a page already accessed through the shim
+          OnRead    // as Touched, applied when a read next covers it
+      };
+
+      // Extent of one fault: corruptionSize contiguous bytes, or a whole
+      // structure of the target DRAM
+      enum class FaultModel {
+          Bytes,
+          Row,     // every column of one row of a bank
+          Column,  // one column in every row of a bank
+          Bank,    // every row of a bank
+          Rank     // every bank of a rank
+      };
+
+      // Position of a burst in the DRAM, as decoded by the controller
+      struct DRAMCoord {
+        uint32_t rank, bank, row, column;
+      };
+
+      // Geometry and address mapping of the target DRAMInterface, read
+      // once at construction
+      struct DRAMGeometry {
+        AddrRange range;
+        uint32_t burst_size, bursts_per_row, bursts_per_stripe;
+        uint32_t ranks, banks, rows;
+        enums::AddrMap mapping;
+      };
+
+      // Extent of a DRAM fault: the rank hit, and the banks, rows and
+      // columns covered in it ([lo, hi) ranges). A stuck-at fault is kept
+      // as is, with its burst mask, and applied to the bursts it covers
+      // by decoding the accessed address
+      struct DRAMFault {
         FaultType fault_type;
-        uint8_t mask;
-        bool update;
+        uint32_t rank;
+        uint32_t bank_lo, bank_hi, row_lo, row_hi, col_lo, col_hi;
+        std::vector<uint8_t> burst_mask;
+
+        bool
+        covers(const DRAMCoord &coord) const
+        {
+            return coord.rank == rank &&
+                   coord.bank >= bank_lo && coord.bank < bank_hi &&
+                   coord.row >= row_lo && coord.row < row_hi &&
+                   coord.column >= col_lo && coord.column < col_hi;
+        }
+      };
+
+      // Fault waiting for the first read of its bytes (OnRead)
+      struct ArmedFault {
+        FaultType fault_type;
+        std::vector<uint8_t> masks;
       };
 
       memory::AbstractMemory* memory;
@@ -48,26 +165,81 @@ namespace gem5 {
       float bit_flip_prob, stuck_at_zero_prob, stuck_at_one_prob;
       int cycles_permament_fault_check;
       bool write_log;
+      bool binary_log;
+      bool campaign_mode;
+      uint64_t seed, experiment;
+      bool use_schedule;
+      chaos::FaultSchedule fault_schedule;
+      std::string fault_map_file;
       Addr target_start, target_end, target_size;
+      TargetSelection target_selection;
+      Addr page_bytes;
+      FaultModel fault_model;
+      DRAMGeometry dram;
+      // Mask of one burst, repeated over a row, applied to every burst
+      // covered by a DRAM fault
+      std::vector<uint8_t> dram_mask;
 
       EventFunctionWrapper attackEvent, periodicCheck;
       Tick first_tick, last_tick, ticks_permament_fault_check;
+      // Ticks of the pending events read from a checkpoint, applied in
+      // startup() (MaxTick: not scheduled)
+      bool restored;
+      Tick restored_attack_tick, restored_check_tick;
       
-      unsigned char generateRandomMask(std::mt19937 &rng, int bits_to_change, int len);
+      unsigned char generateRandomMask(chaos::Philox &rng, int bits_to_change, int len);
+      void openLog();
+      void seedRng();
       void attackMemory();
       void scheduleAttack(Tick time);
       void scheduleCheckPermanentFault(Tick time);
       void checkPermanent();
+      void enforcePermanentFaults();
+      void loadFaultMap();
+      void injectScheduled();
+      void corruptRegion(Addr target_addr, const uint8_t *masks, int size, FaultType fault_type);
+      void addPermanentFaults(Addr target_addr, const uint8_t *masks, int size, FaultType fault_type);
+      void applyPermanentFaults(PacketPtr pkt);
+      void observeAccess(PacketPtr pkt);
+      void triggerArmedFaults(Addr start, Addr end);
+      bool pickTarget(Addr &target_addr);
+      static TargetSelection stringToTargetSelection(const std::string &s);
+      static FaultModel stringToFaultModel(const std::string &s);
+      static const char *faultModelName(FaultModel m);
+      void readDRAMGeometry(memory::DRAMInterface *dram_interface);
+      DRAMCoord decodeDRAM(Addr addr) const;
+      Addr encodeDRAM(const DRAMCoord &coord) const;
+      void corruptDRAM(Addr target_addr, FaultType fault_type);
+      void forEachDRAMRun(const DRAMFault &fault, const std::function<void(Addr, Addr)> &fn) const;
+      Addr corruptRun(Addr run_start, Addr run_end, chaos::MaskOp op, bool notify);
+      void applyDRAMFaults(Addr addr, uint8_t *data, Addr size) const;
+      bool hasPermanentFaults() const;
+      bool isInterposed() const;
+      bool isInjecting() const;
       const char* faultTypeToString(CHAOSMem::FaultType f);
       static FaultType stringToFaultType(const std::string &s);
 
       std::geometric_distribution<unsigned> inter_fault_tick_dist;
       std::discrete_distribution<int> random_fault_distribution;
       
-      std::mt19937 rng;
+      chaos::Philox rng;
       std::random_device rd;
-      std::map<Addr, PermanentFault> permanent_faults;
+      // Stuck cells, sampled or imported from the fault map
+      chaos::FaultOverlay permanent_faults;
+      // Stuck-at DRAM structures, one entry per fault whatever its size
+      std::vector<DRAMFault> dram_stuck_faults;
+      // Per-byte masks of the region being corrupted, reused across injections
+      std::vector<uint8_t> mask_buffer;
+      // Pages of the target range accessed so far: one bit per page, plus
+      // the list of their indices to sample from in O(1)
+      std::vector<uint64_t> touched_bitmap;
+      std::vector<uint32_t> touched_pages;
+      std::map<Addr, ArmedFault> armed_faults;
       OutputStream *log_stream;
+      chaos::BinaryLog bin_log;
+
+      CPUSidePort cpuSidePort;
+      MemSidePort memSidePort;
 
       struct CHAOSMemStats : public statistics::Group
       {
@@ -76,6 +248,9 @@ namespace gem5 {
         statistics::Scalar numStuckAtZero;
         statistics::Scalar numStuckAtOne;
         statistics::Scalar numPermanentFaults;
+        statistics::Scalar numArmedFaults;
+        statistics::Scalar numSkippedFaults;
+        statistics::Scalar numDRAMBytesCorrupted;
         
         CHAOSMemStats(statistics::Group *parent);
       };
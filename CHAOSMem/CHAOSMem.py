@@ -1,14 +1,17 @@
 from m5.params import *
 from m5.SimObject import SimObject
+from m5.util.pybind import PyBindMethod
 
 class CHAOSMem(SimObject):
     type = 'CHAOSMem'
     cxx_class = 'gem5::CHAOSMem'
+    cxx_exports = [PyBindMethod("startExperiment"), PyBindMethod("armFault")]
     cxx_header = "mem/CHAOSMem/CHAOSMem.hh"
 
     mem = Param.AbstractMemory(NULL, "Main memory pointer.")
     probability = Param.Float(0.0, "Probability (between 0 and 1) of processing cache fault injection")
     bitsToChange = Param.Int(-1, "Number of bits to change in the target cache packet during fault injection (from 0 to 8)")
+    corruptionSize = Param.Int(1, "Number of contiguous bytes to modify in each fault injection (e.g. 4096 for a whole page)")
     firstClock = Param.UInt64(0, "Clock cycle after which the cache fault injector is enabled (default 0)")
     lastClock = Param.UInt64(0, "Clock cycle after which the cache fault injector is disabled (default last clock cycle)")
     faultType = Param.String("random", "Type of alteration to be performed")
@@ -17,7 +20,19 @@ class CHAOSMem(SimObject):
     bitFlipProb = Param.Float(0.9, "Probability (between 0 and 1) of injecting a bit flip fault on 'random' fault type")
     stuckAtZeroProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-zero fault on 'random' fault type")
     stuckAtOneProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-one flip fault on 'random' fault type")
-    cyclesPermamentFaultCheck = Param.Int(1, "Number of cycles between each periodic check for permanent faults.")
+    cyclesPermamentFaultCheck = Param.Int(1, "Number of cycles between each periodic check for permanent faults (only used when the ports are not connected).")
     addr_start = Param.Addr(0, "Start address of the memory-mapped range (default: 0)")
     addr_end = Param.Addr(0, "End address of the memory-mapped range (default: 0, full memory length)")
-    writeLog = Param.Bool(True, "Write a log file")
\ No newline at end of file
+    targetSelection = Param.String("uniform", "Target address selection: uniform, touched (pages already accessed) or on_read (as touched, applied at the next read of the bytes). touched and on_read need the ports")
+    pageSize = Param.MemorySize("4KiB", "Granularity of the touched-page tracking")
+    faultModel = Param.String("bytes", "Extent of a fault: bytes (corruptionSize contiguous bytes), or the row, column, bank or rank of the hit cell (mem must be a DRAMInterface)")
+    writeLog = Param.Bool(True, "Write a log file")
+    logFormat = Param.String("text", "Log format: text, or binary (buffered fixed-size records, decoded by tools/decode_log.py)")
+    campaignMode = Param.Bool(False, "Stay idle until startExperiment() is called (fork-based campaigns)")
+    seed = Param.UInt64(0, "Seed of the fault injection RNG (0 picks a random seed, reported at startup)")
+    experiment = Param.UInt64(0, "Experiment index, selects an independent RNG stream for the same seed")
+
+    cpu_side_port = ResponsePort("Optional port facing the memory bus, used to enforce stuck-at faults on the access path")
+    mem_side_port = RequestPort("Optional port facing the memory controller")
+    faultSchedule = Param.String("", "Binary fault schedule to replay instead of sampling faults online (times in ticks)")
+    faultMap = Param.String("", "Binary map of stuck cells (e.g. a measured DRAM fault map), loaded at startup and enforced for the whole run (see tools/fault_map.py)")
\ No newline at end of file
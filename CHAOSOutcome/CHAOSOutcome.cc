@@ -0,0 +1,314 @@
+#include "CHAOSOutcome/CHAOSOutcome.hh"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+
+#include "base/logging.hh"
+#include "base/output.hh"
+#include "mem/port_proxy.hh"
+#include "sim/core.hh"
+#include "sim/sim_exit.hh"
+#include "CHAOSCommon/state_hash.hh"
+
+namespace gem5 {
+
+    CHAOSOutcome *CHAOSOutcome::monitor = nullptr;
+    struct sigaction CHAOSOutcome::prev_abort_action;
+
+    CHAOSOutcome::CHAOSOutcome(const CHAOSOutcomeParams &p)
+    : SimObject(p),
+    system(p.system),
+    cpus(p.cpus.begin(), p.cpus.end()),
+    golden_file(p.goldenFile),
+    record_golden(p.recordGolden),
+    output_file(p.outputFile),
+    output_addr(p.outputAddr),
+    output_size(p.outputSize),
+    watchdog_interval(p.watchdogInterval),
+    hang_margin(p.hangMargin),
+    outcome_file(p.outcomeFile),
+    tick_to_clock_ratio(p.tickToClockRatio),
+    golden{0, 0, 0, 0},
+    start_tick(0),
+    start_insts(0),
+    last_insts(0),
+    num_faults(0),
+    hang_detected(false),
+    classified(false),
+    outcome(Outcome::Masked),
+    watchdogEvent([this] { this->watchdog(); }, name()),
+    stats(std::make_unique<CHAOSOutcomeStats>(this))
+    {
+        if (monitor) {
+            fatal("CHAOSOutcome: only one outcome monitor per simulation is supported.\n");
+        }
+        if (golden_file.empty()) {
+            fatal("CHAOSOutcome: goldenFile must be set.\n");
+        }
+        if (watchdog_interval == 0) {
+            fatal("CHAOSOutcome: watchdogInterval must be greater than 0.\n");
+        }
+        if (output_file.empty() && output_size == 0) {
+            warn("CHAOSOutcome: neither outputFile nor outputSize is set, SDCs cannot be detected.\n");
+        }
+
+        if (!record_golden) {
+            std::ifstream in(golden_file, std::ios::binary);
+            if (!in || !in.read(reinterpret_cast<char *>(&golden), sizeof(golden))) {
+                fatal("CHAOSOutcome: Could not read golden file %s\n", golden_file);
+            }
+        }
+
+        monitor = this;
+        chaos::registerInjectionObserver(this);
+
+        // Runs whose script does not call classify() are classified when
+        // gem5 exits normally (exit code 0)
+        registerExitCallback([this] {
+            if (!classified)
+                classify("", 0);
+        });
+    }
+
+    CHAOSOutcome::~CHAOSOutcome()
+    {
+        chaos::unregisterInjectionObserver(this);
+        monitor = nullptr;
+    }
+
+    CHAOSOutcome::CHAOSOutcomeStats::CHAOSOutcomeStats(statistics::Group *parent)
+    : statistics::Group(parent),
+      ADD_STAT(numWatchdogChecks, statistics::units::Count::get(),
+               "Number of progress checks of the hang watchdog"),
+      ADD_STAT(numFaultsObserved, statistics::units::Count::get(),
+               "Number of faults injected by all the injectors"),
+      ADD_STAT(outcome, statistics::units::Count::get(),
+               "Outcome of the run (0 masked, 1 SDC, 2 crash, 3 hang)")
+    {
+    }
+
+    void
+    CHAOSOutcome::init()
+    {
+        SimObject::init();
+
+        // fatal() ends gem5 with exit(1) and panic() with abort(), neither
+        // returns to the Python script: the crash record is written from
+        // these two paths.
+        static bool handlers_installed = false;
+        if (!handlers_installed) {
+            struct sigaction action = {};
+            action.sa_handler = abortHandler;
+            sigemptyset(&action.sa_mask);
+            sigaction(SIGABRT, &action, &prev_abort_action);
+            std::atexit(exitHandler);
+            handlers_installed = true;
+        }
+    }
+
+    void
+    CHAOSOutcome::startup()
+    {
+        SimObject::startup();
+
+        // The thread contexts are registered by the CPUs during init()
+        if (cpus.empty()) {
+            for (int i = 0; i < system->threads.size(); i++) {
+                BaseCPU *cpu = system->threads[i]->getCpuPtr();
+                if (std::find(cpus.begin(), cpus.end(), cpu) == cpus.end()) {
+                    cpus.push_back(cpu);
+                }
+            }
+        }
+
+        start_tick = curTick();
+        start_insts = committedInsts();
+        last_insts = start_insts;
+
+        schedule(watchdogEvent, curTick() + watchdog_interval * tick_to_clock_ratio);
+    }
+
+    const char *
+    CHAOSOutcome::outcomeName(Outcome o)
+    {
+        switch (o) {
+          case Outcome::Masked: return "masked";
+          case Outcome::SDC: return "sdc";
+          case Outcome::Crash: return "crash";
+          case Outcome::Hang: return "hang";
+        }
+        return "unknown";
+    }
+
+    void
+    CHAOSOutcome::faultInjected(bool permanent)
+    {
+        num_faults++;
+        stats->numFaultsObserved++;
+    }
+
+    uint64_t
+    CHAOSOutcome::committedInsts() const
+    {
+        uint64_t insts = 0;
+        for (const auto *cpu : cpus) {
+            insts += cpu->totalInsts();
+        }
+        return insts;
+    }
+
+    uint64_t
+    CHAOSOutcome::hashOutputFile()
+    {
+        // The simulated program writes its output file through unbuffered
+        // host file descriptors, it is complete on disk
+        std::ifstream in(simout.resolve(output_file), std::ios::binary);
+        if (!in) {
+            warn("CHAOSOutcome: Could not read output file %s\n", output_file);
+        }
+        std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+        return chaos::hashBytes(data.data(), data.size(), 0);
+    }
+
+    uint64_t
+    CHAOSOutcome::hashOutputRegion()
+    {
+        std::vector<uint8_t> region(output_size);
+        system->physProxy.readBlob(output_addr, region.data(), output_size);
+        return chaos::hashBytes(region.data(), region.size(), output_addr);
+    }
+
+    void
+    CHAOSOutcome::watchdog()
+    {
+        stats->numWatchdogChecks++;
+
+        uint64_t insts = committedInsts();
+        uint64_t run_insts = insts - start_insts;
+        Tick run_ticks = curTick() - start_tick;
+
+        if (insts == last_insts) {
+            hang_reason = "no instruction committed in " + std::to_string(watchdog_interval) + " cycles";
+        } else if (!record_golden &&
+                   (run_ticks > golden.ticks * (1.0 + hang_margin) ||
+                    run_insts > golden.insts * (1.0 + hang_margin))) {
+            hang_reason = "no completion within the margin of the golden run";
+        } else {
+            last_insts = insts;
+            schedule(watchdogEvent, curTick() + watchdog_interval * tick_to_clock_ratio);
+            return;
+        }
+
+        hang_detected = true;
+        exitSimLoop("CHAOS: hang detected, " + hang_reason, 0);
+    }
+
+    std::string
+    CHAOSOutcome::classify(const std::string &cause, int code)
+    {
+        if (classified)
+            return outcomeName(outcome);
+
+        std::string reason = cause;
+
+        if (hang_detected) {
+            outcome = Outcome::Hang;
+            reason = "CHAOS: hang detected, " + hang_reason;
+        } else if (cause == "simulate() limit reached") {
+            outcome = Outcome::Hang;
+        } else if (cause.find("CHAOS: state converged") == 0) {
+            // Stopped early by CHAOSConvergence, the output would match
+            outcome = Outcome::Masked;
+        } else if (code != 0) {
+            outcome = Outcome::Crash;
+        } else {
+            uint64_t file_hash = output_file.empty() ? 0 : hashOutputFile();
+            uint64_t region_hash = (output_size == 0) ? 0 : hashOutputRegion();
+            if (record_golden) {
+                GoldenOutcome record = {committedInsts() - start_insts, curTick() - start_tick,
+                                        file_hash, region_hash};
+                OutputStream *out = simout.create(golden_file, true, true);
+                if (!out || !out->stream()) {
+                    panic("CHAOSOutcome: Could not open golden file %s", golden_file);
+                }
+                out->stream()->write(reinterpret_cast<const char *>(&record), sizeof(record));
+                simout.close(out);
+                outcome = Outcome::Masked;
+            } else {
+                // Only the outputs enabled in this run are compared, so a
+                // golden run can record both
+                bool sdc = (!output_file.empty() && file_hash != golden.file_hash) ||
+                           (output_size > 0 && region_hash != golden.region_hash);
+                outcome = sdc ? Outcome::SDC : Outcome::Masked;
+            }
+        }
+
+        classified = true;
+        stats->outcome = static_cast<int>(outcome);
+        writeRecord(outcome, reason, code);
+        inform("CHAOSOutcome: %s (%s)\n", outcomeName(outcome), reason);
+
+        return outcomeName(outcome);
+    }
+
+    void
+    CHAOSOutcome::discardRun()
+    {
+        classified = true;
+    }
+
+    void
+    CHAOSOutcome::writeRecord(Outcome o, const std::string &cause, int code)
+    {
+        // Also called from the abort handler: the record is formatted into a
+        // local buffer and written with a single write()
+        char line[512];
+        int len = snprintf(line, sizeof(line),
+                           "Outcome: %s, Tick: %llu, Insts: %llu, Faults: %llu, Code: %d, Cause: %s\n",
+                           outcomeName(o), (unsigned long long)curTick(),
+                           (unsigned long long)(committedInsts() - start_insts),
+                           (unsigned long long)num_faults, code, cause.c_str());
+        len = std::min(len, int(sizeof(line)) - 1);
+
+        std::string path = simout.resolve(outcome_file);
+        int fd = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd < 0)
+            return;
+        ssize_t written = ::write(fd, line, len);
+        (void)written;
+        ::close(fd);
+    }
+
+    void
+    CHAOSOutcome::abortHandler(int sig)
+    {
+        if (monitor && !monitor->classified) {
+            monitor->classified = true;
+            monitor->outcome = Outcome::Crash;
+            monitor->writeRecord(Outcome::Crash, "gem5 panic", sig);
+        }
+
+        // SIGABRT is blocked while the handler runs, the signal raised here
+        // reaches the previous handler (gem5's backtrace) once it returns
+        sigaction(SIGABRT, &prev_abort_action, nullptr);
+        raise(SIGABRT);
+    }
+
+    void
+    CHAOSOutcome::exitHandler()
+    {
+        // A normal exit has already been classified by the exit callback
+        if (monitor && !monitor->classified) {
+            monitor->classified = true;
+            monitor->outcome = Outcome::Crash;
+            monitor->writeRecord(Outcome::Crash, "gem5 fatal error", 1);
+        }
+    }
+
+} // namespace gem5
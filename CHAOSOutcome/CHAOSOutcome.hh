@@ -0,0 +1,111 @@
+#ifndef __CHAOSOUTCOME_HH__
+#define __CHAOSOUTCOME_HH__
+
+#include <csignal>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "base/statistics.hh"
+#include "cpu/base.hh"
+#include "params/CHAOSOutcome.hh"
+#include "sim/eventq.hh"
+#include "sim/sim_object.hh"
+#include "sim/system.hh"
+#include "CHAOSCommon/injection_observer.hh"
+
+namespace gem5 {
+
+  // Outcome monitor of a fault injection run. It ends hung runs as soon as
+  // they are detected and classifies every run as masked, SDC (the output
+  // differs from the golden run), crash (non-zero exit, fatal error or
+  // panic of the simulated program) or hang, in a one-line record.
+  class CHAOSOutcome : public SimObject, public chaos::InjectionObserver {
+    public:
+      enum class Outcome {
+          Masked,
+          SDC,
+          Crash,
+          Hang
+      };
+
+      CHAOSOutcome(const CHAOSOutcomeParams &p);
+      ~CHAOSOutcome();
+
+      void init() override;
+      void startup() override;
+
+      void faultInjected(bool permanent) override;
+
+      // Classifies the run from the cause and code of the event that ended
+      // the simulation, writes the record and returns the outcome name.
+      // Only the first call classifies, later calls return the same name.
+      std::string classify(const std::string &cause, int code);
+
+      // The run simulated by this process is not an experiment (e.g. the
+      // golden prefix of a fork-based campaign, in the parent): it is not
+      // classified when gem5 exits.
+      void discardRun();
+
+    private:
+      struct GoldenOutcome {
+        uint64_t insts;
+        uint64_t ticks;
+        uint64_t file_hash;
+        uint64_t region_hash;
+      };
+
+      System *system;
+      std::vector<BaseCPU *> cpus;
+      std::string golden_file;
+      bool record_golden;
+      std::string output_file;
+      Addr output_addr;
+      Addr output_size;
+      uint64_t watchdog_interval;
+      double hang_margin;
+      std::string outcome_file;
+      int tick_to_clock_ratio;
+
+      GoldenOutcome golden;
+      Tick start_tick;
+      uint64_t start_insts;
+      uint64_t last_insts;
+      uint64_t num_faults;
+      bool hang_detected;
+      std::string hang_reason;
+      bool classified;
+      Outcome outcome;
+
+      EventFunctionWrapper watchdogEvent;
+
+      // Instance reported by the fatal/panic handlers
+      static CHAOSOutcome *monitor;
+      static struct sigaction prev_abort_action;
+
+      static const char *outcomeName(Outcome o);
+      static void abortHandler(int sig);
+      static void exitHandler();
+
+      uint64_t committedInsts() const;
+      uint64_t hashOutputFile();
+      uint64_t hashOutputRegion();
+      void watchdog();
+      void writeRecord(Outcome o, const std::string &cause, int code);
+
+      struct CHAOSOutcomeStats : public statistics::Group
+      {
+        statistics::Scalar numWatchdogChecks;
+        statistics::Scalar numFaultsObserved;
+        statistics::Scalar outcome;
+
+        CHAOSOutcomeStats(statistics::Group *parent);
+      };
+
+      std::unique_ptr<CHAOSOutcomeStats> stats;
+  };
+
+} // namespace gem5
+
+#endif // __CHAOSOUTCOME_HH__
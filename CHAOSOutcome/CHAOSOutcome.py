@@ -0,0 +1,22 @@
+from m5.params import *
+from m5.proxy import *
+from m5.SimObject import SimObject
+from m5.util.pybind import PyBindMethod
+
+class CHAOSOutcome(SimObject):
+    type = 'CHAOSOutcome'
+    cxx_class = 'gem5::CHAOSOutcome'
+    cxx_header = "CHAOSOutcome/CHAOSOutcome.hh"
+    cxx_exports = [PyBindMethod("classify"), PyBindMethod("discardRun")]
+
+    system = Param.System(Parent.any, "System running the workload")
+    cpus = VectorParam.BaseCPU([], "CPUs whose committed instructions are watched (default: the CPUs of all the threads of the system)")
+    goldenFile = Param.String("golden_outcome.bin", "Golden reference of the run (written with recordGolden, read otherwise)")
+    recordGolden = Param.Bool(False, "Record the golden reference instead of comparing with it (fault-free run)")
+    outputFile = Param.String("", "Output file of the workload, relative to the output directory (e.g. Process.output), hashed to detect SDCs")
+    outputAddr = Param.Addr(0, "Physical start address of a memory region holding the results, hashed to detect SDCs")
+    outputSize = Param.MemorySize("0B", "Size of the memory region holding the results (0: no region)")
+    watchdogInterval = Param.UInt64(1000000, "Clock cycles between two progress checks of the hang watchdog")
+    hangMargin = Param.Float(0.5, "A run taking more than (1 + hangMargin) times the golden ticks or instructions is a hang")
+    outcomeFile = Param.String("outcome.txt", "File receiving the one-line classification record")
+    tickToClockRatio = Param.Int(1000, "Ratio between tick and clock cycle (tick/cycle)")
\ No newline at end of file
@@ -3,63 +3,145 @@
 
 #include <iostream>
 #include <fstream>
+#include <algorithm>
 #include <vector>
 #include <random>
 #include <bitset>
+#include <cmath>
+#include <cstring>
 
+#include "base/cprintf.hh"
 #include "cpu/base.hh"
 #include "cpu/thread_context.hh"
 #include "arch/generic/isa.hh"
+#include "CHAOSCommon/checkpoint.hh"
 
 namespace gem5{
 
+    // Number of target registers drawn before giving up on an injection
+    // whose candidates all fall into dead intervals.
+    static constexpr int maxResampleAttempts = 32;
+
     CHAOSReg::CHAOSReg(const CHAOSRegParams &p)
         : SimObject(p),
-        cpu(dynamic_cast<BaseCPU *>(p.cpu)),
+        cpus(p.cpus.begin(), p.cpus.end()),
+        num_threads(0),
+        cpu(nullptr),
         probability(p.probability),
         num_bits_to_change(p.bitsToChange),
         first_clock(Cycles(p.firstClock)),
         last_clock(Cycles(p.lastClock)),
         fault_type_enum(stringToFaultType(p.faultType)),
-        fault_mask(std::bitset<32>(p.faultMask)),
+        fault_mask(p.faultMask),
         bit_flip_prob(p.bitFlipProb),
         stuck_at_zero_prob(p.stuckAtZeroProb),
         stuck_at_one_prob(p.stuckAtOneProb),
-        cycles_permament_fault_check(Cycles(p.cyclesPermamentFaultCheck)),
         reg_target_class_enum(stringToTargetClass(p.regTargetClass)),
+        target_structure(stringToTargetStructure(p.targetStructure)),
         PC_target(p.PCTarget),
         write_log(p.writeLog),
+        binary_log(p.logFormat == "binary"),
+        campaign_mode(p.campaignMode),
+        seed(p.seed),
+        experiment(p.experiment),
+        armed(!p.campaignMode),
+        use_schedule(!p.faultSchedule.empty()),
+        ace_analysis(p.aceAnalysis),
+        dead_intervals_file(p.deadIntervals),
+        dead_fault_policy(p.deadFaultPolicy == "skip" ? DeadFaultPolicy::Skip : DeadFaultPolicy::Resample),
+        num_tracked_regs{0, 0},
+        dead_intervals_stream(nullptr),
         attackEvent([this] { this->attackCheck(); }, name()),
-        periodicCheck([this] { this->checkPermanent(); }, name() + ".periodicCheck"),
-        stats(nullptr)
+        restored(false),
+        restored_attack_tick(MaxTick),
+        stats(nullptr),
+        avf_stats(nullptr)
     {
-        if (probability > 0.0){
+        if (cpus.empty() && p.cpu) {
+            cpus.push_back(p.cpu);
+        }
+        for (auto *target : cpus) {
+            thread_base.push_back(num_threads);
+            num_threads += target->numThreads;
+            if (target->clockPeriod() != cpus[0]->clockPeriod()) {
+                warn("CHAOSReg: %s and %s have different clocks, cycles are counted on %s.\n",
+                     cpus[0]->name(), target->name(), cpus[0]->name());
+            }
+        }
+        cpu = cpus.empty() ? nullptr : cpus[0];
+
+        if (target_structure != TargetStructure::Architectural) {
+            for (auto *target : cpus) {
+                if (!isO3CPU(target)) {
+                    fatal("CHAOSReg: targetStructure=%s needs an O3 CPU, %s is not.\n",
+                          p.targetStructure, target->name());
+                }
+            }
+        }
+
+        if (ace_analysis) {
             if (!cpu) {
                 throw std::runtime_error("CHAOSReg: Invalid CPU pointer.\n");
             }
 
-            log_stream = simout.create("fault_injections.log", false, true);
-            if (!log_stream || !log_stream->stream()) {
-                panic("CHAOSReg: Could not open log file");
+            const auto &reg_classes = cpu->getContext(0)->getIsaPtr()->regClasses();
+            num_tracked_regs = {(int)reg_classes[gem5::IntRegClass]->numRegs(),
+                                (int)reg_classes[gem5::FloatRegClass]->numRegs()};
+            for (int c = 0; c < 2; c++) {
+                reg_last_event[c].assign(num_threads * num_tracked_regs[c], Cycles(0));
+            }
+
+            avf_stats = std::make_unique<CHAOSRegAVFStats>(this, num_threads * (num_tracked_regs[0] + num_tracked_regs[1]));
+
+            if (!dead_intervals_file.empty()) {
+                dead_intervals_stream = simout.create(dead_intervals_file, true, true);
+                if (!dead_intervals_stream || !dead_intervals_stream->stream()) {
+                    panic("CHAOSReg: Could not open dead interval file %s", dead_intervals_file);
+                }
             }
+        } else if (!dead_intervals_file.empty()) {
+            loadDeadIntervals();
+        }
 
-            stats = std::make_unique<CHAOSRegStats>(this);
+        if (probability > 0.0 || use_schedule || campaign_mode){
+            if (seed == 0) {
+                seed = (uint64_t(rd()) << 32) | rd();
+            }
+            seedRng();
 
-            rng.seed(rd());
-            if (PC_target != 0){
-                // In this case, it is necessary to check at every cycle if the PC matches, so it is better to set the probability to 1.
-                probability = 1;
+            if (!cpu) {
+                throw std::runtime_error("CHAOSReg: Invalid CPU pointer.\n");
             }
 
-            if (num_bits_to_change == -1){
-                std::uniform_int_distribution<int> dist(1, 32);
-                num_bits_to_change = dist(rng);
+            // In campaign mode the log is opened by startExperiment(), once
+            // the forked child has its own output directory.
+            if (!campaign_mode || use_schedule) {
+                openLog();
             }
 
-            inter_fault_cycles_dist = std::geometric_distribution<unsigned>(probability);
-            
-            unsigned next_fault_cycle_distance = inter_fault_cycles_dist(rng);
-            scheduleAttackEvent(first_clock + Cycles(next_fault_cycle_distance));
+            stats = std::make_unique<CHAOSRegStats>(this, cpus.size());
+
+            if (use_schedule) {
+                // Faults come from the schedule file, no sampling takes place
+                fault_schedule.open(p.faultSchedule);
+                armed = true;
+                if (!fault_schedule.done()) {
+                    scheduleAttackEvent(Cycles(fault_schedule.peek().when));
+                }
+            } else if (probability > 0.0) {
+                // One merged stream for all the CPUs: a fault hits one of N
+                // CPUs in a cycle with probability 1 - (1 - p)^N, the CPU is
+                // drawn at each injection
+                double rate = (cpus.size() == 1) ? probability : 1.0 - std::pow(1.0 - probability, cpus.size());
+                inter_fault_cycles_dist = std::geometric_distribution<unsigned>(rate);
+            }
+
+            // With a PC target, injections are driven by the PC triggers
+            // installed in startup() instead of the geometric draw.
+            if (PC_target == 0 && !campaign_mode && !use_schedule){
+                unsigned next_fault_cycle_distance = inter_fault_cycles_dist(rng);
+                scheduleAttackEvent(first_clock + Cycles(next_fault_cycle_distance));
+            }
             
             if ((bit_flip_prob + stuck_at_zero_prob + stuck_at_one_prob) != 1.0){
                 warn("Sum of probabilities is not 1, assuming 0.9 for bitFlipProb, 0.05 for stuckAtZeroProb and 0.05 for stuckAtOneProb.\n");
@@ -70,12 +152,10 @@ namespace gem5{
 
             std::vector<double> weights = {bit_flip_prob, stuck_at_zero_prob, stuck_at_one_prob};
             random_fault_distribution = std::discrete_distribution<int>(weights.begin(), weights.end());
-
-            scheduleCheckPermanentFault(first_clock + cycles_permament_fault_check);
         }
     }
 
-    CHAOSReg::CHAOSRegStats::CHAOSRegStats(statistics::Group *parent)
+    CHAOSReg::CHAOSRegStats::CHAOSRegStats(statistics::Group *parent, int num_cores)
     : statistics::Group(parent),
       ADD_STAT(numFaultsInjected, statistics::units::Count::get(),
                "Total number of faults injected"),
@@ -86,12 +166,362 @@ namespace gem5{
       ADD_STAT(numStuckAtOne, statistics::units::Count::get(),
                "Number of stuck-at-1 faults injected"),
       ADD_STAT(numPermanentFaults, statistics::units::Count::get(),
-               "Total number of permanent faults injected")
+               "Total number of permanent faults injected"),
+      ADD_STAT(numStuckAtEnforced, statistics::units::Count::get(),
+               "Number of register writes whose stuck-at bits had to be forced again"),
+      ADD_STAT(numPrunedFaults, statistics::units::Count::get(),
+               "Number of injections skipped because they fell into a dead interval"),
+      ADD_STAT(numResampledFaults, statistics::units::Count::get(),
+               "Number of target registers redrawn because they were dead"),
+      ADD_STAT(numNoTargetFaults, statistics::units::Count::get(),
+               "Number of O3 structure injections dropped because the structure held no eligible entry"),
+      ADD_STAT(coreFaultsInjected, statistics::units::Count::get(),
+               "Number of faults injected in each target CPU")
+    {
+        coreFaultsInjected.init(num_cores);
+        for (int core = 0; core < num_cores; core++) {
+            coreFaultsInjected.subname(core, csprintf("core%d", core));
+        }
+    }
+
+    CHAOSReg::CHAOSRegAVFStats::CHAOSRegAVFStats(CHAOSReg *parent, int num_regs)
+    : statistics::Group(parent, "avf"),
+      ADD_STAT(aceRegCycles, statistics::units::Count::get(),
+               "Register-cycles spent by values that are later read (ACE)"),
+      ADD_STAT(unAceRegCycles, statistics::units::Count::get(),
+               "Register-cycles spent by values that are overwritten before being read (un-ACE)"),
+      ADD_STAT(elapsedCycles, statistics::units::Cycle::get(),
+               "Cycles covered by the analysis"),
+      ADD_STAT(avf, statistics::units::Ratio::get(),
+               "Architectural vulnerability factor of the integer and floating-point registers"),
+      injector(parent)
     {
+        aceRegCycles.init(2).subname(0, "integer").subname(1, "floating_point");
+        unAceRegCycles.init(2).subname(0, "integer").subname(1, "floating_point");
+        avf = statistics::sum(aceRegCycles) / (elapsedCycles * statistics::constant(num_regs));
+    }
+
+    void
+    CHAOSReg::CHAOSRegAVFStats::preDumpStats()
+    {
+        statistics::Group::preDumpStats();
+        elapsedCycles = injector->cpu->curCycle();
+
+        // Stats are always dumped at exit, the intervals reach the file
+        if (injector->dead_intervals_stream) {
+            injector->dead_intervals_stream->stream()->flush();
+        }
     }
 
     CHAOSReg::~CHAOSReg(){}
 
+    void
+    CHAOSReg::seedRng()
+    {
+        // Instances sharing the same seed still get independent keys
+        rng.seed(seed ^ chaos::Philox::hashName(name()), experiment);
+        inform("%s: seed %llu, experiment %llu\n", name(), seed, experiment);
+    }
+
+    ThreadContext *
+    CHAOSReg::threadContext(ThreadID thread) const
+    {
+        int core = coreOf(thread);
+        return cpus[core]->getContext(thread - thread_base[core]);
+    }
+
+    int
+    CHAOSReg::coreOf(ThreadID thread) const
+    {
+        return std::upper_bound(thread_base.begin(), thread_base.end(), thread) - thread_base.begin() - 1;
+    }
+
+    uint32_t
+    CHAOSReg::threadLabel(ThreadID thread) const
+    {
+        int core = coreOf(thread);
+        return (uint32_t(core) << 16) | uint32_t(thread - thread_base[core]);
+    }
+
+    ThreadID
+    CHAOSReg::threadFromLabel(uint32_t label) const
+    {
+        uint32_t core = label >> 16;
+        ThreadID tid = label & 0xffff;
+        if (core >= cpus.size() || tid >= cpus[core]->numThreads)
+            return InvalidThreadID;
+        return thread_base[core] + tid;
+    }
+
+    void
+    CHAOSReg::openLog()
+    {
+        if (binary_log) {
+            // Target CPU names, then the register class names indexed by type
+            std::vector<std::string> strings;
+            for (const auto *target : cpus) {
+                strings.push_back(target->name());
+            }
+            for (const auto *reg_class : cpu->getContext(0)->getIsaPtr()->regClasses()) {
+                strings.push_back(reg_class->name());
+            }
+            bin_log.open(simout.resolve("fault_injections.bin"), strings, cpus.size());
+            return;
+        }
+
+        log_stream = simout.create("fault_injections.log", false, true);
+        if (!log_stream || !log_stream->stream()) {
+            panic("CHAOSReg: Could not open log file");
+        }
+    }
+
+    void
+    CHAOSReg::logError(ThreadID thread, const char *what)
+    {
+        int core = coreOf(thread);
+        ThreadID tid = localThread(thread);
+
+        if (binary_log) {
+            bin_log.append({cpu->curCycle(), 0, 0, threadLabel(thread), 0, chaos::LogKind::RegError, 0});
+            warn("CHAOSReg: exception during fault injection on %s thread %d: %s\n",
+                 cpus[core]->name(), tid, what ? what : "unknown");
+            return;
+        }
+
+        // The CPU is only named when there is more than one
+        std::string where = (cpus.size() > 1) ? ", CPU: " + cpus[core]->name() : "";
+        if (what) {
+            *(log_stream->stream())  << "Error: Exception during fault injection. "
+                    << "ThreadID: " << tid << where
+                    << ", Error: " << what << std::endl;
+        } else {
+            *(log_stream->stream())  << "Error: Unknown exception during fault injection. "
+                    << "ThreadID: " << tid << where << std::endl;
+        }
+    }
+
+    void
+    CHAOSReg::startExperiment(uint64_t experiment)
+    {
+        if (probability <= 0.0 || !campaign_mode || use_schedule)
+            return;
+
+        openLog();
+
+        this->experiment = experiment;
+        seedRng();
+        armed = true;
+
+        if (PC_target == 0) {
+            Cycles now = cpu->curCycle();
+            Cycles start = (now < first_clock) ? Cycles(first_clock - now) : Cycles(0);
+            scheduleAttackEvent(start + Cycles(inter_fault_cycles_dist(rng)));
+        }
+    }
+
+    void
+    CHAOSReg::armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                       uint32_t fault_type, uint64_t mask)
+    {
+        if (!campaign_mode || fault_schedule.isOpen()) {
+            warn("CHAOSReg: armFault() needs campaignMode and no faultSchedule, fault ignored.\n");
+            return;
+        }
+
+        // The first armed fault turns the injector into an in-memory schedule
+        if (!use_schedule) {
+            openLog();
+            use_schedule = true;
+            armed = true;
+        }
+
+        fault_schedule.append({when, target, target2, uint16_t(target3), uint8_t(fault_type), 0, mask});
+
+        Cycles now = cpu->curCycle();
+        uint64_t next = fault_schedule.peek().when;
+        scheduleAttackEvent(Cycles(next > now ? next - now : 0));
+    }
+
+    void
+    CHAOSReg::regProbeListeners()
+    {
+        // Stuck-at bits are forced again whenever the register is written,
+        // which is the only time they can be lost. A schedule, or faults
+        // armed by a campaign driver, may hold stuck-at records whatever
+        // faultType says. Structure faults are always transient.
+        bool enforce_stuck_at = target_structure == TargetStructure::Architectural &&
+                                (use_schedule || campaign_mode ||
+                                 (probability > 0.0 && fault_type_enum != FaultType::BitFlip));
+
+        for (int core = 0; core < int(cpus.size()); core++) {
+            BaseCPU *target = cpus[core];
+            bool o3_cpu = isO3CPU(target);
+
+            if (o3_cpu && (target_structure == TargetStructure::ROB ||
+                           target_structure == TargetStructure::IQ)) {
+                listenInFlight(target, core);
+            }
+
+            if (enforce_stuck_at && o3_cpu) {
+                listenWriteback(target);
+            } else if (enforce_stuck_at) {
+                // Simple CPUs run one instruction at a time: whatever it
+                // wrote is fixed before the next one reads it
+                listeners.push_back(std::make_unique<ProbeListenerArgFunc<uint64_t>>(
+                    target->getProbeManager(), "RetiredInsts", [this, core](const uint64_t &) { notifyRetired(core); }));
+            }
+
+            if (!ace_analysis)
+                continue;
+
+            // Only the O3 CPU exposes the committed instructions with their
+            // source and destination registers.
+            if (!o3_cpu) {
+                warn("CHAOSReg: aceAnalysis needs an O3 CPU, no register accesses will be tracked on %s.\n",
+                     target->name());
+                continue;
+            }
+
+            listenCommit(target);
+        }
+    }
+
+    void
+    CHAOSReg::startup()
+    {
+        SimObject::startup();
+
+        if (restored) {
+            // The event scheduled by the constructor assumed a start at cycle 0
+            chaos::restoreEvent(*this, attackEvent, restored_attack_tick);
+
+            // An experiment started before the checkpoint logs to this run
+            if (campaign_mode && !use_schedule && armed) {
+                openLog();
+            }
+        }
+
+        if (probability <= 0.0 || PC_target == 0 || use_schedule)
+            return;
+
+        for (ThreadID thread = 0; thread < num_threads; ++thread) {
+            ThreadContext *thread_context = threadContext(thread);
+            if (!thread_context)
+                continue;
+
+            pc_triggers.push_back(std::make_unique<PCTrigger>(this, thread_context, thread, PC_target));
+        }
+    }
+
+    bool
+    CHAOSReg::isInjecting() const
+    {
+        return probability > 0.0 || use_schedule || campaign_mode;
+    }
+
+    void
+    CHAOSReg::serialize(CheckpointOut &cp) const
+    {
+        bool injecting = isInjecting();
+        SERIALIZE_SCALAR(injecting);
+        if (!injecting)
+            return;
+
+        SERIALIZE_SCALAR(seed);
+        SERIALIZE_SCALAR(experiment);
+        SERIALIZE_SCALAR(num_bits_to_change);
+        SERIALIZE_SCALAR(armed);
+        chaos::serializeRng(cp, rng);
+        chaos::serializeEventTick(cp, "attackTick", attackEvent);
+        if (use_schedule) {
+            paramOut(cp, "schedulePosition", fault_schedule.position());
+        }
+
+        // Registers are saved by the CPUs, the stuck bits are kept as
+        // (thread, register class, index)
+        std::vector<int> fault_threads;
+        std::vector<int> fault_classes;
+        std::vector<int> fault_regs;
+        std::vector<int> fault_types;
+        std::vector<uint64_t> fault_masks;
+        for (const auto &entry : permanent_faults) {
+            fault_threads.push_back(entry.first.first);
+            fault_classes.push_back(int(entry.first.second.classValue()));
+            fault_regs.push_back(entry.first.second.index());
+            fault_types.push_back(int(entry.second.fault_type));
+            // Masks are flattened in 64-bit words, regBytes() of the class
+            // tells how many belong to each fault
+            const auto &mask = entry.second.mask;
+            for (size_t i = 0; i < mask.size(); i += sizeof(uint64_t)) {
+                uint64_t word = 0;
+                std::memcpy(&word, mask.data() + i, std::min(sizeof(word), mask.size() - i));
+                fault_masks.push_back(word);
+            }
+        }
+        SERIALIZE_CONTAINER(fault_threads);
+        SERIALIZE_CONTAINER(fault_classes);
+        SERIALIZE_CONTAINER(fault_regs);
+        SERIALIZE_CONTAINER(fault_types);
+        SERIALIZE_CONTAINER(fault_masks);
+    }
+
+    void
+    CHAOSReg::unserialize(CheckpointIn &cp)
+    {
+        bool injecting;
+        UNSERIALIZE_SCALAR(injecting);
+        if (!injecting || !isInjecting()) {
+            if (injecting != isInjecting()) {
+                warn("CHAOSReg: injection enabled in only one of the checkpoint and the configuration, injector state not restored.\n");
+            }
+            return;
+        }
+
+        UNSERIALIZE_SCALAR(seed);
+        UNSERIALIZE_SCALAR(experiment);
+        UNSERIALIZE_SCALAR(num_bits_to_change);
+        UNSERIALIZE_SCALAR(armed);
+        chaos::unserializeRng(cp, rng);
+        restored_attack_tick = chaos::unserializeEventTick(cp, "attackTick");
+        if (use_schedule) {
+            uint64_t position;
+            paramIn(cp, "schedulePosition", position);
+            fault_schedule.setPosition(position);
+        }
+
+        std::vector<int> fault_threads;
+        std::vector<int> fault_classes;
+        std::vector<int> fault_regs;
+        std::vector<int> fault_types;
+        std::vector<uint64_t> fault_masks;
+        UNSERIALIZE_CONTAINER(fault_threads);
+        UNSERIALIZE_CONTAINER(fault_classes);
+        UNSERIALIZE_CONTAINER(fault_regs);
+        UNSERIALIZE_CONTAINER(fault_types);
+        UNSERIALIZE_CONTAINER(fault_masks);
+        permanent_faults.clear();
+        size_t word = 0;
+        for (size_t i = 0; i < fault_threads.size(); i++) {
+            ThreadID tid = fault_threads[i];
+            if (tid >= num_threads) {
+                fatal("CHAOSReg: the checkpoint holds a fault on thread %d, the target CPUs have %d threads.\n",
+                      tid, num_threads);
+            }
+            const auto &reg_classes = threadContext(tid)->getIsaPtr()->regClasses();
+            gem5::RegId reg_id(*reg_classes[fault_classes[i]], fault_regs[i]);
+            std::vector<uint8_t> mask(reg_classes[fault_classes[i]]->regBytes());
+            for (size_t b = 0; b < mask.size(); b += sizeof(uint64_t), word++) {
+                if (word >= fault_masks.size()) {
+                    fatal("CHAOSReg: the checkpoint holds fewer fault mask words than its faults need.\n");
+                }
+                std::memcpy(mask.data() + b, &fault_masks[word], std::min(sizeof(uint64_t), mask.size() - b));
+            }
+            permanent_faults[std::make_pair(tid, reg_id)] = {static_cast<FaultType>(fault_types[i]), mask};
+        }
+
+        restored = true;
+    }
+
     CHAOSReg::FaultType 
     CHAOSReg::stringToFaultType(const std::string &s) {
         if (s == "bit_flip") return FaultType::BitFlip;
@@ -114,9 +544,32 @@ namespace gem5{
     CHAOSReg::stringToTargetClass(const std::string &s) {
         if (s == "integer") return TargetClass::Integer;
         else if (s == "floating_point") return TargetClass::FloatingPoint;
+        else if (s == "vector") return TargetClass::Vector;
         return TargetClass::Both;
     }
 
+    CHAOSReg::TargetStructure
+    CHAOSReg::stringToTargetStructure(const std::string &s) {
+        if (s == "physical_regfile") return TargetStructure::PhysRegFile;
+        else if (s == "rob") return TargetStructure::ROB;
+        else if (s == "iq") return TargetStructure::IQ;
+        else if (s == "lsq") return TargetStructure::LSQ;
+        else if (s != "architectural")
+            fatal("CHAOSReg: unknown targetStructure '%s'\n", s);
+        return TargetStructure::Architectural;
+    }
+
+    const char *
+    CHAOSReg::structureName(TargetStructure s) {
+        switch (s) {
+            case TargetStructure::PhysRegFile: return "physical_regfile";
+            case TargetStructure::ROB: return "rob";
+            case TargetStructure::IQ: return "iq";
+            case TargetStructure::LSQ: return "lsq";
+            default: return "architectural";
+        }
+    }
+
     void 
     CHAOSReg::scheduleAttackEvent(Cycles delay)
     {
@@ -124,153 +577,355 @@ namespace gem5{
             schedule(attackEvent, cpu->clockEdge(delay));
     }
 
-    void 
-    CHAOSReg::scheduleCheckPermanentFault(Cycles delay)
-    {
-        if (!periodicCheck.scheduled())
-            schedule(periodicCheck, cpu->clockEdge(delay));
-    }
-
     void 
     CHAOSReg::unscheduleAttackEvent()
     {
         if (attackEvent.scheduled())
             attackEvent.squash();
-
-        if (periodicCheck.scheduled())
-            periodicCheck.squash();
     }
 
-    int 
-    CHAOSReg::generateRandomMask(std::mt19937 &gen, int bits_to_change, int len)
+    void
+    CHAOSReg::generateRandomMask(chaos::Philox &gen, int bits_to_change, uint8_t *mask, size_t bytes)
     {
-        int mask = 0;
-        std::uniform_int_distribution<int> bitDist(0, len-1);
+        std::uniform_int_distribution<int> bitDist(0, bytes * 8 - 1);
 
         while (bits_to_change-- > 0) {
-            mask |= (1 << bitDist(gen));
+            int bit = bitDist(gen);
+            mask[bit / 8] |= uint8_t(1) << (bit % 8);
         }
-        return mask;
     }
 
-    void 
-    CHAOSReg::processFault(ThreadID tid)
+    chaos::MaskOp
+    CHAOSReg::maskOp(FaultType f)
+    {
+        switch (f) {
+            case FaultType::StuckAtZero: return chaos::MaskOp::Clear;
+            case FaultType::StuckAtOne: return chaos::MaskOp::Set;
+            default: return chaos::MaskOp::Xor;
+        }
+    }
+
+    gem5::RegVal
+    CHAOSReg::maskWord(const std::vector<uint8_t> &mask)
+    {
+        gem5::RegVal word = 0;
+        std::memcpy(&word, mask.data(), std::min(sizeof(word), mask.size()));
+        return word;
+    }
+
+    std::string
+    CHAOSReg::maskString(const std::vector<uint8_t> &mask)
+    {
+        // Up to 64 bits in binary, vector masks in hex, lowest byte first
+        if (mask.size() <= sizeof(uint64_t))
+            return std::bitset<64>(maskWord(mask)).to_string();
+
+        std::string hex;
+        for (uint8_t byte : mask) {
+            hex += csprintf("%02x", byte);
+        }
+        return hex;
+    }
+
+    void
+    CHAOSReg::applyRegMask(ThreadContext *tc, const RegId &reg_id, FaultType fault_type,
+                           const std::vector<uint8_t> &mask)
+    {
+        // Raw register bytes: one path for 64-bit and vector registers
+        std::vector<uint8_t> value(mask.size());
+        tc->getReg(reg_id, value.data());
+        chaos::applyMask(value.data(), mask.data(), value.size(), maskOp(fault_type));
+        tc->setReg(reg_id, value.data());
+    }
+
+    void
+    CHAOSReg::appendLog(chaos::LogRecord record, const std::vector<uint8_t> &mask)
+    {
+        // The first 8 mask bytes travel in the record, the rest of a vector
+        // mask in MemMask continuation records
+        record.mask = maskWord(mask);
+        bin_log.append(record);
+        for (size_t i = sizeof(uint64_t); i < mask.size(); i += sizeof(uint64_t)) {
+            uint64_t chunk = 0;
+            std::memcpy(&chunk, mask.data() + i, std::min(sizeof(chunk), mask.size() - i));
+            bin_log.append({record.time, record.target, chunk, 0, 0,
+                            chaos::LogKind::MemMask, record.fault_type});
+        }
+    }
+
+    const gem5::RegClass *
+    CHAOSReg::pickRegClass(const BaseISA::RegClasses &reg_classes)
     {
-        gem5::ThreadContext *thread_context = cpu->getContext(tid);
-        if (!thread_context)
-            return;
-    
-        gem5::BaseISA *isa = thread_context->getIsaPtr();
-        if (!isa)
-            return;
-    
-        const auto &reg_classes = isa->regClasses();
         const gem5::RegClass *reg_class = nullptr;
-    
+
         if (reg_target_class_enum == TargetClass::Both) {
             int intRegs = reg_classes[gem5::IntRegClass]->numRegs();
             int floatRegs = reg_classes[gem5::FloatRegClass]->numRegs();
 
             if (intRegs == 0 && floatRegs == 0) {
                 warn("processFault: No registers found\n");
-                return;
+                return nullptr;
             } 
             if (intRegs > 0 && floatRegs == 0) {
                 reg_class = reg_classes[gem5::IntRegClass];
             } else if (intRegs == 0 && floatRegs > 0) {
                 reg_class = reg_classes[gem5::FloatRegClass];
             } else {
-                reg_class = (rand() % 2 == 0) ? reg_classes[gem5::IntRegClass] : reg_classes[gem5::FloatRegClass];
+                reg_class = std::bernoulli_distribution(0.5)(rng) ? reg_classes[gem5::IntRegClass] : reg_classes[gem5::FloatRegClass];
             }
         } else if (reg_target_class_enum == TargetClass::Integer) {
             reg_class = reg_classes[gem5::IntRegClass];
-            if (reg_class->numRegs() == 0) return;
         } else if (reg_target_class_enum == TargetClass::FloatingPoint) {
             reg_class = reg_classes[gem5::FloatRegClass];
-            if (reg_class->numRegs() == 0) return;
+        } else if (reg_target_class_enum == TargetClass::Vector) {
+            reg_class = reg_classes[gem5::VecRegClass];
         }
+
+        return reg_class;
+    }
+
+    void 
+    CHAOSReg::processFault(ThreadID tid)
+    {
+        gem5::ThreadContext *thread_context = threadContext(tid);
+        if (!thread_context)
+            return;
+    
+        gem5::BaseISA *isa = thread_context->getIsaPtr();
+        if (!isa)
+            return;
+    
+        const auto &reg_classes = isa->regClasses();
+        const gem5::RegClass *reg_class = pickRegClass(reg_classes);
     
         if (!reg_class || reg_class->numRegs() == 0)
             return;
     
         int random_reg = std::uniform_int_distribution<>(0, reg_class->numRegs() - 1)(rng);
-        gem5::RegId reg_id(*reg_class, random_reg);
-        
-        try {
-            gem5::RegVal reg_val = thread_context->getReg(reg_id);
 
-            int mask = fault_mask.any() ? fault_mask.to_ulong() : generateRandomMask(rng, num_bits_to_change, sizeof(reg_val) << 3);
-    
-            FaultType chosen_fault_type_enum = fault_type_enum;
-            if (fault_type_enum == FaultType::Random) {
-                int faultIdx = random_fault_distribution(rng);
-                chosen_fault_type_enum = static_cast<FaultType>(faultIdx);
+        // In the golden run this register was overwritten before being read
+        // again: the fault is certainly masked, do not spend a run on it.
+        for (int attempt = 1; isDeadFault(tid, *reg_class, random_reg); attempt++) {
+            if (dead_fault_policy == DeadFaultPolicy::Skip || attempt == maxResampleAttempts) {
+                stats->numPrunedFaults++;
+                return;
             }
-    
+            stats->numResampledFaults++;
+
+            reg_class = pickRegClass(reg_classes);
+            if (!reg_class || reg_class->numRegs() == 0)
+                return;
+            random_reg = std::uniform_int_distribution<>(0, reg_class->numRegs() - 1)(rng);
+        }
+
+        FaultType chosen_fault_type_enum;
+        std::vector<uint8_t> mask;
+        drawFault(chosen_fault_type_enum, mask, reg_class->regBytes());
+
+        injectRegFault(tid, *reg_class, random_reg, chosen_fault_type_enum, mask);
+    }
+
+    void
+    CHAOSReg::drawFault(FaultType &fault_type, std::vector<uint8_t> &mask, size_t bytes)
+    {
+        // Random masks span the whole register, faultMask its lowest 64 bits.
+        // Without bitsToChange, the number of bits is drawn for each fault
+        // up to the width of the register.
+        mask.assign(bytes, 0);
+        if (fault_mask != 0) {
+            std::memcpy(mask.data(), &fault_mask, std::min(sizeof(fault_mask), bytes));
+        } else {
+            int bits_to_change = num_bits_to_change;
+            if (bits_to_change == -1) {
+                bits_to_change = std::uniform_int_distribution<int>(1, bytes * 8)(rng);
+            }
+            generateRandomMask(rng, bits_to_change, mask.data(), bytes);
+        }
+
+        fault_type = fault_type_enum;
+        if (fault_type_enum == FaultType::Random) {
+            int faultIdx = random_fault_distribution(rng);
+            fault_type = static_cast<FaultType>(faultIdx);
+        }
+    }
+
+    gem5::RegVal
+    CHAOSReg::applyFault(gem5::RegVal value, FaultType fault_type, gem5::RegVal mask)
+    {
+        switch (fault_type) {
+            case FaultType::StuckAtZero: return value & ~mask;
+            case FaultType::StuckAtOne: return value | mask;
+            case FaultType::BitFlip: return value ^ mask;
+            default: return value;
+        }
+    }
+
+    void
+    CHAOSReg::logStructureFault(int core, uint64_t entry, int field,
+                                FaultType chosen_fault_type_enum, const std::vector<uint8_t> &mask)
+    {
+        // Faults in the O3 structures are transient: a stuck-at value is
+        // applied once, the entry is reallocated soon after. ROB and IQ
+        // faults are reported in flight until their instruction leaves the
+        // pipeline. A store may still wait in the store queue after commit:
+        // LSQ faults are reported as permanent, and never seen as masked.
+        stats->numFaultsInjected++;
+        stats->coreFaultsInjected[core]++;
+        switch (chosen_fault_type_enum) {
+            case FaultType::StuckAtZero: stats->numStuckAtZero++; break;
+            case FaultType::StuckAtOne: stats->numStuckAtOne++; break;
+            case FaultType::BitFlip: stats->numBitFlips++; break;
+            default: break;
+        }
+        chaos::notifyFaultInjected(target_structure == TargetStructure::LSQ);
+
+        if (write_log && binary_log) {
+            appendLog({cpu->curCycle(), entry, 0, (uint32_t(core) << 16) | uint32_t(field),
+                       uint16_t(target_structure), chaos::LogKind::O3,
+                       uint8_t(chosen_fault_type_enum)}, mask);
+        } else if (write_log) {
+            std::string field_name;
+            switch (target_structure) {
+                case TargetStructure::PhysRegFile:
+                    field_name = cpus[core]->getContext(0)->getIsaPtr()->regClasses()[field]->name();
+                    break;
+                case TargetStructure::ROB: field_name = csprintf("dest%d", field); break;
+                case TargetStructure::IQ: field_name = csprintf("src%d", field); break;
+                default: field_name = field ? "address" : "data"; break;
+            }
+            *(log_stream->stream())  << "Cycle: " << cpu->curCycle()
+                << ", CPU: " << cpus[core]->name()
+                << ", Structure: " << structureName(target_structure)
+                << ", Entry: " << entry
+                << ", Field: " << field_name
+                << ", FaultType: " << faultTypeToString(chosen_fault_type_enum)
+                << ", Mask: " << maskString(mask)
+                << std::endl;
+        }
+    }
+
+    void
+    CHAOSReg::injectRegFault(ThreadID tid, const RegClass &reg_class, int reg_idx,
+                             FaultType chosen_fault_type_enum, const std::vector<uint8_t> &mask)
+    {
+        gem5::ThreadContext *thread_context = threadContext(tid);
+        gem5::RegId reg_id(reg_class, reg_idx);
+        int core = coreOf(tid);
+
+        try {
+            applyRegMask(thread_context, reg_id, chosen_fault_type_enum, mask);
+
             switch (chosen_fault_type_enum) {
                 case FaultType::StuckAtZero:
-                    reg_val &= ~mask;
                     stats->numStuckAtZero++;
                     stats->numPermanentFaults++;
-                    permanent_faults[std::make_pair(tid, reg_id)] = {chosen_fault_type_enum, mask, true};
+                    permanent_faults[std::make_pair(tid, reg_id)] = {chosen_fault_type_enum, mask};
                     break;
                 case FaultType::StuckAtOne:
-                    reg_val |= mask;
                     stats->numStuckAtOne++;
                     stats->numPermanentFaults++;
-                    permanent_faults[std::make_pair(tid, reg_id)] = {chosen_fault_type_enum, mask, true};
+                    permanent_faults[std::make_pair(tid, reg_id)] = {chosen_fault_type_enum, mask};
                     break;
                 case FaultType::BitFlip:
-                    reg_val ^= mask;
                     stats->numBitFlips++;
                     break;
                 default:
                     break;
             }
-    
-            thread_context->setReg(reg_id, reg_val);
+
             stats->numFaultsInjected++;
-            
-            if (write_log){
+            stats->coreFaultsInjected[core]++;
+            chaos::notifyFaultInjected(chosen_fault_type_enum != FaultType::BitFlip);
+
+            if (write_log && binary_log) {
+                appendLog({cpu->curCycle(), uint64_t(reg_idx), 0, threadLabel(tid),
+                           uint16_t(reg_class.type()), chaos::LogKind::Reg,
+                           uint8_t(chosen_fault_type_enum)}, mask);
+            } else if (write_log){
                 *(log_stream->stream())  << "Cycle: " << cpu->curCycle()
-                    << ", CPU: " << cpu->name()
-                    << ", Thread: " << tid
-                    << ", Register: " << reg_class->name() << "[" << random_reg << "]"
+                    << ", CPU: " << cpus[core]->name()
+                    << ", Thread: " << localThread(tid)
+                    << ", Register: " << reg_class.name() << "[" << reg_idx << "]"
                     << ", FaultType: " << faultTypeToString(chosen_fault_type_enum)
-                    << ", Mask: " << std::bitset<32>(mask)
+                    << ", Mask: " << maskString(mask)
                     << std::endl;
             }
 
         } catch (const std::exception &e) {
-            *(log_stream->stream())  << "Error: Exception during fault injection. "
-                    << "ThreadID: " << tid
-                    << ", Error: " << e.what() << std::endl;
+            logError(tid, e.what());
         } catch (...) {
-            *(log_stream->stream())  << "Error: Unknown exception during fault injection. "
-                    << "ThreadID: " << tid << std::endl;
+            logError(tid, nullptr);
+        }
+    }
+
+    void
+    CHAOSReg::injectScheduled()
+    {
+        Cycles now = cpu->curCycle();
+
+        while (!fault_schedule.done() && fault_schedule.peek().when <= now) {
+            const chaos::FaultRecord &record = fault_schedule.next();
+
+            ThreadID tid = threadFromLabel(record.target2);
+            ThreadContext *thread_context = (tid != InvalidThreadID) ? threadContext(tid) : nullptr;
+            if (!thread_context || record.fault_type > uint8_t(FaultType::StuckAtOne)) {
+                warn("CHAOSReg: skipping invalid scheduled fault (CPU %d, thread %d)\n",
+                     record.target2 >> 16, record.target2 & 0xffff);
+                continue;
+            }
+
+            const auto &reg_classes = thread_context->getIsaPtr()->regClasses();
+            if (record.target3 >= reg_classes.size() ||
+                record.target >= reg_classes[record.target3]->numRegs()) {
+                warn("CHAOSReg: skipping scheduled fault on unknown register %d:%d\n",
+                     record.target3, record.target);
+                continue;
+            }
+
+            // The record holds the lowest 64 bits of the mask
+            std::vector<uint8_t> mask(reg_classes[record.target3]->regBytes(), 0);
+            std::memcpy(mask.data(), &record.mask, std::min(sizeof(record.mask), mask.size()));
+            injectRegFault(tid, *reg_classes[record.target3], record.target,
+                           static_cast<FaultType>(record.fault_type), mask);
+        }
+
+        if (!fault_schedule.done()) {
+            scheduleAttackEvent(Cycles(fault_schedule.peek().when - now));
         }
     }
 
     void 
     CHAOSReg::attackCheck()
     {
+        if (use_schedule) {
+            injectScheduled();
+            return;
+        }
+
         if (!probability)
             return;
 
-        for (ThreadID tid = 0; tid < cpu->numThreads; ++tid) {
-            ThreadContext *thread_context = cpu->getContext(tid);
+        // The draw covers all the CPUs, pick the one it hits. With a single
+        // CPU no number is drawn, so single-core runs keep their stream.
+        int core = (cpus.size() == 1) ? 0 : std::uniform_int_distribution<int>(0, cpus.size() - 1)(rng);
+        bool core_active = false;
+        for (ThreadID tid = thread_base[core]; tid < thread_base[core] + cpus[core]->numThreads; ++tid) {
+            ThreadContext *thread_context = threadContext(tid);
             if (!thread_context || thread_context->status() == ThreadContext::Halted) {
                 continue;
             }
 
-            if (PC_target == 0 || (PC_target == thread_context->pcState().instAddr())) {
+            core_active = true;
+            if (target_structure == TargetStructure::Architectural)
                 processFault(tid);
-            }
+        }
+        if (core_active && target_structure != TargetStructure::Architectural) {
+            processStructureFault(core);
         }
 
         bool any_active = false;
-        for (ThreadID tid = 0; tid < cpu->numThreads; ++tid) {
-            ThreadContext *thread_context = cpu->getContext(tid);
+        for (ThreadID tid = 0; tid < num_threads; ++tid) {
+            ThreadContext *thread_context = threadContext(tid);
             if (thread_context && thread_context->status() != ThreadContext::Halted) {
                 any_active = true;
                 break;
@@ -286,47 +941,166 @@ namespace gem5{
         }
     }
 
-    void 
-    CHAOSReg::checkPermanent()
+    void
+    CHAOSReg::pcTriggered(ThreadID tid)
     {
-        for (auto &entry : permanent_faults) {
-            if (!entry.second.update)
-                continue;
+        Cycles now = cpu->curCycle();
+        if (!armed || now < first_clock || (last_clock != 0 && now > last_clock))
+            return;
 
-            ThreadID tid = entry.first.first;
-            gem5::RegId reg_id = entry.first.second;
-            const PermanentFault &fault = entry.second;
-
-            try {
-                gem5::ThreadContext *thread_context = cpu->getContext(tid);
-                if (!thread_context)
-                    continue;
-
-                gem5::RegVal reg_val = thread_context->getReg(reg_id);
-
-                switch (fault.fault_type) {
-                    case FaultType::StuckAtZero:
-                        reg_val &= ~fault.mask;
-                        break;
-                    case FaultType::StuckAtOne:
-                        reg_val |= fault.mask;
-                        break;
-                    default:
-                        break;
+        if (target_structure == TargetStructure::Architectural) {
+            processFault(tid);
+        } else {
+            processStructureFault(coreOf(tid));
+        }
+    }
+
+    void
+    CHAOSReg::notifyRetired(int core)
+    {
+        if (permanent_faults.empty())
+            return;
+
+        // The simple CPUs expose the instruction they just retired: only
+        // its destinations can have lost their stuck bits
+        ThreadID thread;
+        StaticInstPtr inst = retiredInst(cpus[core], thread);
+        if (inst) {
+            ThreadID tid = thread_base[core] + thread;
+            gem5::ThreadContext *thread_context = threadContext(tid);
+            if (!thread_context)
+                return;
+
+            for (int i = 0; i < inst->numDestRegs(); i++) {
+                RegId reg = inst->destRegIdx(i).flatten(*thread_context->getIsaPtr());
+                auto it = permanent_faults.find(std::make_pair(tid, reg));
+                if (it != permanent_faults.end()) {
+                    enforceStuckAt(tid, reg, it->second);
                 }
+            }
+            return;
+        }
+
+        // Other CPUs (Minor) do not: every stuck register of the CPU is
+        // checked
+        for (const auto &entry : permanent_faults) {
+            if (coreOf(entry.first.first) == core) {
+                enforceStuckAt(entry.first.first, entry.first.second, entry.second);
+            }
+        }
+    }
+
+    bool
+    CHAOSReg::stuckAtViolated(const uint8_t *value, const PermanentFault &fault)
+    {
+        // A stuck-at-0 bit reads 1, or a stuck-at-1 bit reads 0
+        bool stuck_at_zero = fault.fault_type == FaultType::StuckAtZero;
+        for (size_t i = 0; i < fault.mask.size(); i++) {
+            if ((stuck_at_zero ? value[i] : uint8_t(~value[i])) & fault.mask[i])
+                return true;
+        }
+        return false;
+    }
+
+    void
+    CHAOSReg::enforceStuckAt(ThreadID tid, const RegId &reg, const PermanentFault &fault)
+    {
+        panic_if(fault.mask.size() > maxRegBytes, "CHAOSReg: %d-byte register, at most %d supported.\n",
+                 fault.mask.size(), maxRegBytes);
+
+        try {
+            gem5::ThreadContext *thread_context = threadContext(tid);
+            if (!thread_context)
+                return;
 
-                thread_context->setReg(reg_id, reg_val);
-                entry.second.update = false;
-            } catch (const std::exception &e) {
-                *(log_stream->stream())  << "Error: Exception during fault injection. "
-                        << "ThreadID: " << tid
-                        << ", Error: " << e.what() << std::endl;
-            } catch (...) {
-                *(log_stream->stream())  << "Error: Unknown exception during fault injection. "
-                        << "ThreadID: " << tid << std::endl;
+            alignas(uint64_t) uint8_t value[maxRegBytes];
+            thread_context->getReg(reg, value);
+            if (stuckAtViolated(value, fault)) {
+                chaos::applyMask(value, fault.mask.data(), fault.mask.size(), maskOp(fault.fault_type));
+                thread_context->setReg(reg, value);
+                stats->numStuckAtEnforced++;
             }
+        } catch (const std::exception &e) {
+            logError(tid, e.what());
+        } catch (...) {
+            logError(tid, nullptr);
+        }
+    }
 
-            scheduleCheckPermanentFault(cycles_permament_fault_check);
+    int
+    CHAOSReg::aceClassIndex(RegClassType type)
+    {
+        switch (type) {
+            case gem5::IntRegClass: return 0;
+            case gem5::FloatRegClass: return 1;
+            default: return -1;
         }
     }
+
+    uint64_t
+    CHAOSReg::deadIntervalKey(ThreadID tid, int reg_class, int reg_idx)
+    {
+        return (uint64_t(tid) << 32) | (uint64_t(reg_class) << 16) | uint64_t(reg_idx);
+    }
+
+    void
+    CHAOSReg::regAccess(ThreadID tid, const RegId &reg, bool write)
+    {
+        int c = aceClassIndex(reg.classValue());
+        if (c < 0 || reg.index() >= num_tracked_regs[c] || tid >= num_threads)
+            return;
+
+        // The interval since the previous access of the register is ACE if
+        // it ends with a read, un-ACE if the value is overwritten.
+        Cycles now = cpu->curCycle();
+        Cycles &last = reg_last_event[c][tid * num_tracked_regs[c] + reg.index()];
+
+        if (write) {
+            avf_stats->unAceRegCycles[c] += now - last;
+            if (dead_intervals_stream && now > last) {
+                DeadInterval interval = {last, now, uint32_t(tid), uint16_t(reg.classValue()), uint16_t(reg.index())};
+                dead_intervals_stream->stream()->write(reinterpret_cast<const char *>(&interval), sizeof(interval));
+            }
+        } else {
+            avf_stats->aceRegCycles[c] += now - last;
+        }
+        last = now;
+    }
+
+    void
+    CHAOSReg::loadDeadIntervals()
+    {
+        std::ifstream in(dead_intervals_file, std::ios::binary);
+        if (!in) {
+            fatal("CHAOSReg: Could not open dead interval file %s\n", dead_intervals_file);
+        }
+
+        DeadInterval interval;
+        uint64_t count = 0;
+        while (in.read(reinterpret_cast<char *>(&interval), sizeof(interval))) {
+            dead_intervals[deadIntervalKey(interval.tid, interval.reg_class, interval.reg_idx)]
+                .emplace_back(interval.start, interval.end);
+            count++;
+        }
+        inform("CHAOSReg: %llu dead intervals loaded from %s\n", count, dead_intervals_file);
+    }
+
+    bool
+    CHAOSReg::isDeadFault(ThreadID tid, const RegClass &reg_class, int reg_idx) const
+    {
+        if (dead_intervals.empty())
+            return false;
+
+        auto it = dead_intervals.find(deadIntervalKey(tid, reg_class.type(), reg_idx));
+        if (it == dead_intervals.end())
+            return false;
+
+        // Strictly inside the interval: at its bounds the read or write of
+        // the same cycle may happen after the injection.
+        uint64_t now = cpu->curCycle();
+        const auto &intervals = it->second;
+        auto interval = std::upper_bound(intervals.begin(), intervals.end(), now,
+            [](uint64_t cycle, const std::pair<uint64_t, uint64_t> &i) { return cycle < i.second; });
+        return interval != intervals.end() && interval->first < now;
+    }
 } // namespace gem5
\ No newline at end of file
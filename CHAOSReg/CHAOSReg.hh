@@ -1,25 +1,67 @@
 #ifndef __CHAOSReg_HH__
 #define __CHAOSReg_HH__
 
+#include <array>
 #include <random>
+#include <set>
 #include <bitset>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
 
 #include "params/CHAOSReg.hh"
 #include "sim/sim_object.hh"
 #include "sim/eventq.hh"
+#include "arch/generic/isa.hh"
 #include "cpu/base.hh"
+#include "cpu/pc_event.hh"
+#include "cpu/static_inst_fwd.hh"
+#include "cpu/thread_context.hh"
+#include "base/refcnt.hh"
+#include "sim/probe/probe.hh"
 
 #include <stdexcept>
 #include "base/output.hh"
+#include "CHAOSCommon/binary_log.hh"
+#include "CHAOSCommon/fault_schedule.hh"
+#include "CHAOSCommon/injection_observer.hh"
+#include "CHAOSCommon/mask_kernels.hh"
+#include "CHAOSCommon/philox.hh"
 
 namespace gem5
 {
+  // The O3 CPU is only built with a real ISA: everything that needs its
+  // headers lives in CHAOSRegO3.cc (CHAOSRegNoO3.cc otherwise)
+  namespace o3
+  {
+    class CPU;
+    class DynInst;
+    class PhysRegFile;
+  }
+
   class CHAOSReg : public SimObject
   {
     public:
       CHAOSReg(const CHAOSRegParams &p);
       ~CHAOSReg();
 
+      void startup() override;
+      void regProbeListeners() override;
+      void serialize(CheckpointOut &cp) const override;
+      void unserialize(CheckpointIn &cp) override;
+
+      // Campaign mode: arm the injector for experiment 'experiment' from the
+      // current tick, with an RNG stream of its own (called after a fork).
+      void startExperiment(uint64_t experiment);
+
+      // Campaign mode: inject the given fault (a fault schedule record,
+      // see CHAOSCommon/fault_schedule.hh) at cycle 'when'. Faults armed in the
+      // same run must be given in time order.
+      void armFault(uint64_t when, uint64_t target, uint32_t target2, uint32_t target3,
+                    uint32_t fault_type, uint64_t mask);
+
     private:
       enum class FaultType {
           BitFlip,
@@ -31,47 +73,178 @@ namespace gem5
       enum class TargetClass {
           Both,
           Integer,
-          FloatingPoint
+          FloatingPoint,
+          Vector
+      };
+
+      // Where the faults go: the architectural registers through the thread
+      // context, or a structure of the O3 pipeline reached directly
+      enum class TargetStructure {
+          Architectural,
+          PhysRegFile,
+          ROB,
+          IQ,
+          LSQ
+      };
+
+      enum class DeadFaultPolicy {
+          Skip,
+          Resample
+      };
+
+      // Interval [start, end) in which a register holds a value that is
+      // overwritten without being read (24 bytes in the dead interval file).
+      // tid is the thread index across all the target CPUs.
+      struct DeadInterval {
+        uint64_t start;
+        uint64_t end;
+        uint32_t tid;
+        uint16_t reg_class;
+        uint16_t reg_idx;
       };
       
+      // The mask covers the raw bytes of the register (RegClass::regBytes())
       struct PermanentFault {
         FaultType fault_type;
-        int mask;
-        bool update;
+        std::vector<uint8_t> mask;
       };
 
+      // Largest register of the supported ISAs (RISC-V vectors at the
+      // maximum VLEN), read into a stack buffer to enforce stuck-at faults
+      static constexpr size_t maxRegBytes = 8192;
+
+      // Instruction-address breakpoint used in PCTarget mode: it is
+      // serviced by the CPU only when the thread reaches the target PC,
+      // so no per-cycle polling is needed.
+      class PCTrigger : public PCEvent
+      {
+        private:
+          CHAOSReg *injector;
+          ThreadID tid;
+
+        public:
+          PCTrigger(CHAOSReg *injector, ThreadContext *tc, ThreadID tid, Addr pc)
+            : PCEvent(tc, injector->name() + ".pcTrigger", pc),
+              injector(injector), tid(tid)
+          {}
+
+          void process(ThreadContext *tc) override { injector->pcTriggered(tid); }
+      };
+
+      // Target CPUs. Threads are numbered across all of them, CPU by CPU;
+      // the first CPU gives the clock of the injector.
+      std::vector<BaseCPU *> cpus;
+      std::vector<ThreadID> thread_base;
+      ThreadID num_threads;
       BaseCPU *cpu;
       float probability;
       int num_bits_to_change;
       Cycles first_clock, last_clock;
       FaultType fault_type_enum;
-      std::bitset<32> fault_mask;
+      uint64_t fault_mask;
       float bit_flip_prob, stuck_at_zero_prob, stuck_at_one_prob;
-      Cycles cycles_permament_fault_check;
       TargetClass reg_target_class_enum;
+      TargetStructure target_structure;
       Addr PC_target;
       bool write_log;
+      bool binary_log;
+      bool campaign_mode;
+      uint64_t seed, experiment;
+      bool armed;
+      bool use_schedule;
+      chaos::FaultSchedule fault_schedule;
+
+      // Register-file ACE analysis, driven by the O3 commit probe: cycle of
+      // the last read or write of every integer and floating-point register,
+      // indexed by thread * numRegs + reg for each of the two classes.
+      bool ace_analysis;
+      std::string dead_intervals_file;
+      DeadFaultPolicy dead_fault_policy;
+      std::array<std::vector<Cycles>, 2> reg_last_event;
+      std::array<int, 2> num_tracked_regs;
+      OutputStream *dead_intervals_stream;
+      // Dead intervals of the golden run, per (tid, class, register) key,
+      // sorted by end cycle
+      std::unordered_map<uint64_t, std::vector<std::pair<uint64_t, uint64_t>>> dead_intervals;
+      std::vector<std::unique_ptr<ProbeListener>> listeners;
+
+      EventFunctionWrapper attackEvent;
+      // Tick of the pending injection read from a checkpoint, applied in
+      // startup() (MaxTick: not scheduled)
+      bool restored;
+      Tick restored_attack_tick;
 
-      EventFunctionWrapper attackEvent, periodicCheck;
+      ThreadContext *threadContext(ThreadID thread) const;
+      int coreOf(ThreadID thread) const;
+      ThreadID localThread(ThreadID thread) const { return thread - thread_base[coreOf(thread)]; }
+      // Thread as written in logs and fault schedules: (CPU << 16) | thread
+      uint32_t threadLabel(ThreadID thread) const;
+      ThreadID threadFromLabel(uint32_t label) const;
 
-      int generateRandomMask(std::mt19937 &gen, int bits_to_change, int len);
+      void openLog();
+      void logError(ThreadID tid, const char *what);
+      void seedRng();
+      void generateRandomMask(chaos::Philox &gen, int bits_to_change, uint8_t *mask, size_t bytes);
+      void drawFault(FaultType &fault_type, std::vector<uint8_t> &mask, size_t bytes);
+      static chaos::MaskOp maskOp(FaultType f);
+      static gem5::RegVal maskWord(const std::vector<uint8_t> &mask);
+      static std::string maskString(const std::vector<uint8_t> &mask);
+      void applyRegMask(ThreadContext *tc, const RegId &reg_id, FaultType fault_type,
+                        const std::vector<uint8_t> &mask);
+      void appendLog(chaos::LogRecord record, const std::vector<uint8_t> &mask);
       void processFault(ThreadID tid);
+      static bool isO3CPU(BaseCPU *cpu);
+      static StaticInstPtr retiredInst(BaseCPU *cpu, ThreadID &thread);
+      static bool stuckAtViolated(const uint8_t *value, const PermanentFault &fault);
+      void enforceStuckAt(ThreadID tid, const RegId &reg, const PermanentFault &fault);
+      static o3::PhysRegFile &physRegFile(o3::CPU *o3_cpu);
+      static gem5::RegVal applyFault(gem5::RegVal value, FaultType fault_type, gem5::RegVal mask);
+      void processStructureFault(int core);
+      void injectPhysRegFile(int core);
+      void injectROB(int core);
+      void injectIQ(int core);
+      void injectLSQ(int core);
+      void logStructureFault(int core, uint64_t entry, int field,
+                             FaultType chosen_fault_type_enum, const std::vector<uint8_t> &mask);
+      const RegClass *pickRegClass(const BaseISA::RegClasses &reg_classes);
+      static int aceClassIndex(RegClassType type);
+      static uint64_t deadIntervalKey(ThreadID tid, int reg_class, int reg_idx);
+      void loadDeadIntervals();
+      bool isDeadFault(ThreadID tid, const RegClass &reg_class, int reg_idx) const;
+      void regAccess(ThreadID tid, const RegId &reg, bool write);
+      void listenCommit(BaseCPU *target);
+      void listenWriteback(BaseCPU *target);
+      void listenInFlight(BaseCPU *target, int core);
+      void trackInFlight(int core, uint64_t seq_num);
+      void notifyCommit(const RefCountingPtr<o3::DynInst> &inst);
+      void notifyWriteback(const RefCountingPtr<o3::DynInst> &inst);
+      void notifyRetired(int core);
+      void injectRegFault(ThreadID tid, const RegClass &reg_class, int reg_idx,
+                          FaultType chosen_fault_type_enum, const std::vector<uint8_t> &mask);
+      void injectScheduled();
+      bool isInjecting() const;
       void scheduleAttackEvent(Cycles delay);
       void unscheduleAttackEvent();
-      void scheduleCheckPermanentFault(Cycles delay);
-      void checkPermanent();
       void attackCheck();
+      void pcTriggered(ThreadID tid);
       const char* faultTypeToString(CHAOSReg::FaultType f);
       static FaultType stringToFaultType(const std::string &s);
       static TargetClass stringToTargetClass(const std::string &s);
+      static TargetStructure stringToTargetStructure(const std::string &s);
+      static const char *structureName(TargetStructure s);
 
       std::geometric_distribution<unsigned> inter_fault_cycles_dist;
       std::discrete_distribution<int> random_fault_distribution;
 
-      std::mt19937 rng;
+      chaos::Philox rng;
       std::random_device rd;
       std::map<std::pair<ThreadID, gem5::RegId>, PermanentFault> permanent_faults;
+      std::vector<std::unique_ptr<PCTrigger>> pc_triggers;
+      // (core, sequence number) of the instructions holding a ROB or IQ
+      // fault, until they commit or are squashed
+      std::set<std::pair<int, uint64_t>> in_flight_faults;
       OutputStream *log_stream;
+      chaos::BinaryLog bin_log;
 
       struct CHAOSRegStats : public statistics::Group
       {
@@ -80,11 +253,31 @@ namespace gem5
         statistics::Scalar numStuckAtZero;
         statistics::Scalar numStuckAtOne;
         statistics::Scalar numPermanentFaults;
+        statistics::Scalar numStuckAtEnforced;
+        statistics::Scalar numPrunedFaults;
+        statistics::Scalar numResampledFaults;
+        statistics::Scalar numNoTargetFaults;
+        statistics::Vector coreFaultsInjected;
         
-        CHAOSRegStats(statistics::Group *parent);
+        CHAOSRegStats(statistics::Group *parent, int num_cores);
       };
       
       std::unique_ptr<CHAOSRegStats> stats;
+
+      struct CHAOSRegAVFStats : public statistics::Group
+      {
+        statistics::Vector aceRegCycles;
+        statistics::Vector unAceRegCycles;
+        statistics::Scalar elapsedCycles;
+        statistics::Formula avf;
+
+        CHAOSRegAVFStats(CHAOSReg *parent, int num_regs);
+        void preDumpStats() override;
+
+        CHAOSReg *injector;
+      };
+
+      std::unique_ptr<CHAOSRegAVFStats> avf_stats;
   };
 
 } // namespace gem5
@@ -1,22 +1,34 @@
 from m5.params import *
 from m5.SimObject import SimObject
+from m5.util.pybind import PyBindMethod
 
 class CHAOSReg(SimObject):
     type = 'CHAOSReg'
     cxx_class = 'gem5::CHAOSReg'
     cxx_header = "CHAOSReg/CHAOSReg.hh"
+    cxx_exports = [PyBindMethod("startExperiment"), PyBindMethod("armFault")]
 
     cpu = Param.BaseCPU(NULL, "Target CPU")
-    probability = Param.Float(0.0, "Probability (between 0 and 1) of injecting faults")
-    bitsToChange = Param.Int(-1, "Number of bits to change during fault injection")
+    cpus = VectorParam.BaseCPU([], "Target CPUs, sharing one fault stream (default: [cpu])")
+    probability = Param.Float(0.0, "Probability (between 0 and 1) of injecting faults, per cycle and CPU")
+    bitsToChange = Param.Int(-1, "Number of bits to change during fault injection (-1: drawn for each fault, up to the register width)")
     firstClock = Param.UInt64(0, "Clock cycle after which fault injection starts")
     lastClock = Param.UInt64(0, "Clock cycle after which fault injection stops")
     faultType = Param.String("random", "Fault type: bit_flip, stuck_at_zero, stuck_at_one")
-    faultMask = Param.UInt32(0, "Bit mask for the fault (optional)")
-    regTargetClass = Param.String("both", "Target register class: integer, floating_point, or both")
+    faultMask = Param.UInt64(0, "Bit mask for the fault, applied to the lowest 64 bits of the register (optional)")
+    regTargetClass = Param.String("both", "Target register class: integer, floating_point, both, or vector")
+    targetStructure = Param.String("architectural", "Injection target: architectural registers, or physical_regfile, rob, iq or lsq of an O3 CPU")
     bitFlipProb = Param.Float(0.9, "Probability (between 0 and 1) of injecting a bit flip fault on 'bit_flip' fault type")
     stuckAtZeroProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-zero fault on 'stuck_at_zero' fault type")
     stuckAtOneProb = Param.Float(0.05, "Probability (between 0 and 1) of injecting a stuck-at-one flip fault on 'stuck_at_one' fault type")
-    cyclesPermamentFaultCheck = Param.Int(1, "Number of cycles between each periodic check for permanent faults.")
+    cyclesPermamentFaultCheck = Param.Int(1, "Unused: stuck-at faults are re-applied whenever the register is written. Kept for compatibility.")
     PCTarget = Param.Addr(0, "Specific PC value that triggers fault injection")
-    writeLog = Param.Bool(True, "Write a log file")
\ No newline at end of file
+    writeLog = Param.Bool(True, "Write a log file")
+    logFormat = Param.String("text", "Log format: text, or binary (buffered fixed-size records, decoded by tools/decode_log.py)")
+    campaignMode = Param.Bool(False, "Stay idle until startExperiment() is called (fork-based campaigns)")
+    seed = Param.UInt64(0, "Seed of the fault injection RNG (0 picks a random seed, reported at startup)")
+    experiment = Param.UInt64(0, "Experiment index, selects an independent RNG stream for the same seed")
+    faultSchedule = Param.String("", "Binary fault schedule to replay instead of sampling faults online (times in CPU cycles)")
+    aceAnalysis = Param.Bool(False, "Track register def/use intervals of committed instructions (O3 CPU) and report the register-file AVF")
+    deadIntervals = Param.String("", "Dead interval file: written with aceAnalysis (golden run), otherwise used to prune certainly masked injections")
+    deadFaultPolicy = Param.String("resample", "What to do with an injection into a dead interval: skip or resample")
\ No newline at end of file
@@ -0,0 +1,43 @@
+#include "CHAOSReg/CHAOSReg.hh"
+
+#include "base/logging.hh"
+
+// Builds without the O3 CPU (NULL ISA): no CPU is an O3 one, so the
+// constructor rejects the structure targets and no O3 probe is listened to.
+
+namespace gem5{
+
+    bool
+    CHAOSReg::isO3CPU(BaseCPU *cpu)
+    {
+        return false;
+    }
+
+    StaticInstPtr
+    CHAOSReg::retiredInst(BaseCPU *cpu, ThreadID &thread)
+    {
+        return nullptr;
+    }
+
+    void
+    CHAOSReg::listenWriteback(BaseCPU *target)
+    {
+    }
+
+    void
+    CHAOSReg::listenCommit(BaseCPU *target)
+    {
+    }
+
+    void
+    CHAOSReg::listenInFlight(BaseCPU *target, int core)
+    {
+    }
+
+    void
+    CHAOSReg::processStructureFault(int core)
+    {
+        panic("CHAOSReg: O3 structure faults in a build without the O3 CPU.\n");
+    }
+
+} // namespace gem5
\ No newline at end of file
@@ -0,0 +1,306 @@
+#include "CHAOSReg/CHAOSReg.hh"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include "cpu/o3/cpu.hh"
+#include "cpu/o3/dyn_inst.hh"
+#include "cpu/o3/lsq.hh"
+#include "cpu/simple/base.hh"
+#include "sim/system.hh"
+
+// Parts of CHAOSReg that reach into the O3 CPU: the structure faults, and
+// the commit and writeback probes. Only built when gem5 builds the O3 CPU,
+// as are the simple CPUs whose retired instruction is read here too.
+
+namespace gem5{
+
+    bool
+    CHAOSReg::isO3CPU(BaseCPU *cpu)
+    {
+        return dynamic_cast<o3::CPU *>(cpu) != nullptr;
+    }
+
+    StaticInstPtr
+    CHAOSReg::retiredInst(BaseCPU *cpu, ThreadID &thread)
+    {
+        struct SimpleCPUAccessor : public BaseSimpleCPU {
+            ThreadID curThreadPublic() const { return curThread; }
+        };
+
+        // The RetiredInsts probe fires from postExecute(), the current
+        // instruction is the retired one
+        auto *simple_cpu = dynamic_cast<BaseSimpleCPU *>(cpu);
+        if (!simple_cpu)
+            return nullptr;
+        thread = static_cast<SimpleCPUAccessor *>(simple_cpu)->curThreadPublic();
+        return simple_cpu->curStaticInst;
+    }
+
+    void
+    CHAOSReg::listenWriteback(BaseCPU *target)
+    {
+        // Results reach IEW's ToCommit probe before writeback wakes up
+        // their consumers, so no instruction reads the value without the
+        // stuck bits
+        listeners.push_back(std::make_unique<ProbeListenerArg<CHAOSReg, o3::DynInstPtr>>(
+            this, target->getProbeManager(), "ToCommit", &CHAOSReg::notifyWriteback));
+    }
+
+    void
+    CHAOSReg::listenCommit(BaseCPU *target)
+    {
+        listeners.push_back(std::make_unique<ProbeListenerArg<CHAOSReg, o3::DynInstPtr>>(
+            this, target->getProbeManager(), "Commit", &CHAOSReg::notifyCommit));
+    }
+
+    void
+    CHAOSReg::listenInFlight(BaseCPU *target, int core)
+    {
+        // Squashed instructions also leave the ROB through its head
+        for (const char *probe : {"Commit", "Squash"}) {
+            listeners.push_back(std::make_unique<ProbeListenerArgFunc<o3::DynInstPtr>>(
+                target->getProbeManager(), probe, [this, core](const o3::DynInstPtr &inst) {
+                    if (!in_flight_faults.empty() && in_flight_faults.erase(std::make_pair(core, inst->seqNum))) {
+                        chaos::notifyFaultInFlight(false);
+                    }
+                }));
+        }
+    }
+
+    void
+    CHAOSReg::trackInFlight(int core, uint64_t seq_num)
+    {
+        if (in_flight_faults.insert(std::make_pair(core, seq_num)).second) {
+            chaos::notifyFaultInFlight(true);
+        }
+    }
+
+    o3::PhysRegFile &
+    CHAOSReg::physRegFile(o3::CPU *o3_cpu)
+    {
+        struct CPUAccessor : public o3::CPU {
+            o3::PhysRegFile &regFilePublic() { return regFile; }
+        };
+
+        return static_cast<CPUAccessor *>(o3_cpu)->regFilePublic();
+    }
+
+    void
+    CHAOSReg::processStructureFault(int core)
+    {
+        // The structures are shared by the threads of the core: one
+        // injection per draw, into an entry picked uniformly among the
+        // occupied ones.
+        switch (target_structure) {
+            case TargetStructure::PhysRegFile: injectPhysRegFile(core); break;
+            case TargetStructure::ROB: injectROB(core); break;
+            case TargetStructure::IQ: injectIQ(core); break;
+            case TargetStructure::LSQ: injectLSQ(core); break;
+            default: break;
+        }
+    }
+
+    void
+    CHAOSReg::injectPhysRegFile(int core)
+    {
+        // Any physical register, mapped or free: a free one holds a value
+        // that is never read again, the fault is masked as in the hardware
+        o3::PhysRegFile &reg_file = physRegFile(static_cast<o3::CPU *>(cpus[core]));
+        const gem5::RegClass *reg_class = pickRegClass(cpus[core]->getContext(0)->getIsaPtr()->regClasses());
+        if (!reg_class)
+            return;
+
+        auto range = reg_file.getRegIds(reg_class->type());
+        int num_regs = range.second - range.first;
+        if (num_regs == 0) {
+            stats->numNoTargetFaults++;
+            return;
+        }
+        PhysRegIdPtr phys_reg = &*(range.first + std::uniform_int_distribution<int>(0, num_regs - 1)(rng));
+
+        FaultType chosen_fault_type_enum;
+        std::vector<uint8_t> mask;
+        drawFault(chosen_fault_type_enum, mask, reg_class->regBytes());
+
+        std::vector<uint8_t> value(mask.size());
+        reg_file.getReg(phys_reg, value.data());
+        chaos::applyMask(value.data(), mask.data(), value.size(), maskOp(chosen_fault_type_enum));
+        reg_file.setReg(phys_reg, value.data());
+        logStructureFault(core, phys_reg->index(), reg_class->type(), chosen_fault_type_enum, mask);
+    }
+
+    void
+    CHAOSReg::injectROB(int core)
+    {
+        // Result field of the executed, not yet committed ROB entries. The
+        // O3 model keeps results in their destination physical registers.
+        auto *o3_cpu = static_cast<o3::CPU *>(cpus[core]);
+        std::vector<std::pair<o3::DynInstPtr, int>> candidates;
+        for (const auto &inst : o3_cpu->instList) {
+            if (!inst->isInROB() || inst->isSquashed() || !inst->isExecuted() || inst->isCommitted())
+                continue;
+            for (int i = 0; i < inst->numDestRegs(); i++) {
+                if (aceClassIndex(inst->renamedDestIdx(i)->classValue()) >= 0)
+                    candidates.emplace_back(inst, i);
+            }
+        }
+        if (candidates.empty()) {
+            stats->numNoTargetFaults++;
+            return;
+        }
+        const auto &target = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+
+        FaultType chosen_fault_type_enum;
+        std::vector<uint8_t> mask;
+        drawFault(chosen_fault_type_enum, mask, sizeof(gem5::RegVal));
+
+        o3::PhysRegFile &reg_file = physRegFile(o3_cpu);
+        PhysRegIdPtr phys_reg = target.first->renamedDestIdx(target.second);
+        reg_file.setReg(phys_reg, applyFault(reg_file.getReg(phys_reg), chosen_fault_type_enum, maskWord(mask)));
+        logStructureFault(core, target.first->seqNum, target.second, chosen_fault_type_enum, mask);
+        trackInFlight(core, target.first->seqNum);
+    }
+
+    void
+    CHAOSReg::injectIQ(int core)
+    {
+        // Operand tag of the ready sources of the instructions waiting in
+        // the IQ: the instruction then reads another physical register of
+        // the same class. Operand values are not captured by the O3 IQ,
+        // they are read from the register file at issue.
+        auto *o3_cpu = static_cast<o3::CPU *>(cpus[core]);
+        std::vector<std::pair<o3::DynInstPtr, int>> candidates;
+        for (const auto &inst : o3_cpu->instList) {
+            if (!inst->isInIQ() || inst->isIssued() || inst->isSquashed())
+                continue;
+            for (int i = 0; i < inst->numSrcRegs(); i++) {
+                if (inst->readySrcIdx(i) && aceClassIndex(inst->renamedSrcIdx(i)->classValue()) >= 0)
+                    candidates.emplace_back(inst, i);
+            }
+        }
+        if (candidates.empty()) {
+            stats->numNoTargetFaults++;
+            return;
+        }
+        const auto &target = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+
+        FaultType chosen_fault_type_enum;
+        std::vector<uint8_t> mask;
+        drawFault(chosen_fault_type_enum, mask, sizeof(gem5::RegVal));
+
+        PhysRegIdPtr phys_reg = target.first->renamedSrcIdx(target.second);
+        auto range = physRegFile(o3_cpu).getRegIds(phys_reg->classValue());
+        int num_regs = range.second - range.first;
+        int tag = applyFault(phys_reg->index(), chosen_fault_type_enum, maskWord(mask)) % num_regs;
+        target.first->renameSrcReg(target.second, &*(range.first + tag));
+        logStructureFault(core, target.first->seqNum, target.second, chosen_fault_type_enum, mask);
+        trackInFlight(core, target.first->seqNum);
+    }
+
+    void
+    CHAOSReg::injectLSQ(int core)
+    {
+        // Data and address fields of the executed stores waiting in the
+        // store queue, before their packet is sent to memory. Loads are
+        // not covered: their data is already in the physical register
+        // file once they execute.
+        auto *o3_cpu = static_cast<o3::CPU *>(cpus[core]);
+        std::vector<o3::DynInstPtr> candidates;
+        for (const auto &inst : o3_cpu->instList) {
+            if (!inst->isStore() || !inst->isInLSQ() || inst->isSquashed() ||
+                inst->sqIdx == -1 || !inst->effAddrValid())
+                continue;
+            auto &sq_entry = *inst->sqIt;
+            if (sq_entry.valid() && sq_entry.size() > 0 && !sq_entry.completed() &&
+                sq_entry.request() && !sq_entry.request()->isSent())
+                candidates.push_back(inst);
+        }
+        if (candidates.empty()) {
+            stats->numNoTargetFaults++;
+            return;
+        }
+        const o3::DynInstPtr &inst = candidates[std::uniform_int_distribution<size_t>(0, candidates.size() - 1)(rng)];
+        auto &sq_entry = *inst->sqIt;
+
+        // The address is only corrupted once translated, in stores that
+        // are not split across two lines
+        auto *request = dynamic_cast<o3::LSQ::SingleDataRequest *>(sq_entry.request());
+        bool address = request && request->req()->hasPaddr() && std::bernoulli_distribution(0.5)(rng);
+
+        FaultType chosen_fault_type_enum;
+        std::vector<uint8_t> mask;
+        drawFault(chosen_fault_type_enum, mask, sizeof(gem5::RegVal));
+
+        if (address) {
+            // A store sent outside the memory, or across a cache line,
+            // aborts the simulator instead of reaching the program: the
+            // draw is counted as without a target
+            Addr paddr = applyFault(request->req()->getPaddr(), chosen_fault_type_enum, maskWord(mask));
+            unsigned size = request->req()->getSize();
+            if (!o3_cpu->system->isMemAddr(paddr) || !o3_cpu->system->isMemAddr(paddr + size - 1) ||
+                paddr % o3_cpu->cacheLineSize() + size > o3_cpu->cacheLineSize()) {
+                stats->numNoTargetFaults++;
+                return;
+            }
+            request->req()->setPaddr(paddr);
+            inst->physEffAddr = paddr;
+        } else {
+            // Store data, lowest byte first
+            unsigned bytes = std::min<unsigned>(sq_entry.size(), mask.size());
+            chaos::applyMask(reinterpret_cast<uint8_t *>(sq_entry.data()), mask.data(), bytes,
+                             maskOp(chosen_fault_type_enum));
+        }
+        logStructureFault(core, inst->seqNum, address ? 1 : 0, chosen_fault_type_enum, mask);
+    }
+
+    void
+    CHAOSReg::notifyWriteback(const o3::DynInstPtr &inst)
+    {
+        if (permanent_faults.empty() || inst->isSquashed())
+            return;
+
+        auto target = std::find(cpus.begin(), cpus.end(), inst->cpu);
+        if (target == cpus.end())
+            return;
+        ThreadID thread = thread_base[target - cpus.begin()] + inst->threadNumber;
+
+        // The result is already in the renamed physical register, which
+        // becomes the architectural one at commit
+        o3::PhysRegFile &reg_file = physRegFile(inst->cpu);
+        for (int i = 0; i < inst->numDestRegs(); i++) {
+            auto it = permanent_faults.find(std::make_pair(thread, inst->flattenedDestIdx(i)));
+            if (it == permanent_faults.end())
+                continue;
+
+            const PermanentFault &fault = it->second;
+            PhysRegIdPtr phys_reg = inst->renamedDestIdx(i);
+            alignas(uint64_t) uint8_t value[maxRegBytes];
+            reg_file.getReg(phys_reg, value);
+            if (stuckAtViolated(value, fault)) {
+                chaos::applyMask(value, fault.mask.data(), fault.mask.size(), maskOp(fault.fault_type));
+                reg_file.setReg(phys_reg, value);
+                stats->numStuckAtEnforced++;
+            }
+        }
+    }
+
+    void
+    CHAOSReg::notifyCommit(const o3::DynInstPtr &inst)
+    {
+        auto target = std::find(cpus.begin(), cpus.end(), inst->cpu);
+        if (target == cpus.end())
+            return;
+        ThreadID thread = thread_base[target - cpus.begin()] + inst->threadNumber;
+
+        // Sources are read before the destinations are written
+        for (int i = 0; i < inst->numSrcRegs(); i++) {
+            regAccess(thread, inst->srcRegIdx(i), false);
+        }
+        for (int i = 0; i < inst->numDestRegs(); i++) {
+            regAccess(thread, inst->destRegIdx(i), true);
+        }
+    }
+
+} // namespace gem5
\ No newline at end of file
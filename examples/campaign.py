@@ -0,0 +1,239 @@
+""" Fork-based fault injection campaign built on top of two_level.py.
+
+The fault-free prefix of the workload is simulated only once, up to the
+beginning of the injection window (--first-clock). The simulator is then
+forked once per experiment: every child is a copy-on-write snapshot of the
+golden state, arms the CHAOS injectors with its own RNG stream through
+startExperiment() and runs to completion. At most --jobs children run at the
+same time.
+
+With --fault-list, every experiment injects one given fault instead of
+sampling: the CSV has one line per experiment,
+    injector,when,target,target2,target3,fault_type,mask
+where injector is reg, cache or mem and the other fields are those of a
+fault schedule record (see tools/fault_schedule.py).
+
+With --checkpoint, the golden state is restored from a gem5 checkpoint
+instead of being simulated (the checkpoint is taken at the end of the prefix
+if the directory does not exist yet). It is loaded once for the whole
+campaign: every experiment starts from the in-memory copy, so gem5 startup,
+configuration and checkpoint loading are paid once, not per experiment.
+
+Each experiment writes its logs and stats to <outdir>/experimentN, and a
+summary line per experiment is appended to <outdir>/campaign.csv (with the
+outcome of the experiment when --golden-outcome is given).
+
+Usage:
+    gem5.opt examples/campaign.py --experiments=1000 --jobs=32 \\
+        --first-clock=1000000 [binary]
+    gem5.opt examples/campaign.py --checkpoint=golden_ckpt \\
+        --fault-list=faults.csv --first-clock=1000000 [binary]
+"""
+
+import csv
+import os
+import sys
+import traceback
+
+thispath = os.path.dirname(os.path.realpath(__file__))
+sys.path.append(os.path.abspath(thispath + "/../gem5/configs"))
+sys.path.append(os.path.abspath(thispath + "/../tools"))
+from common import SimpleOpts
+from fault_schedule import parse_fault_type
+
+import m5
+from m5.objects import *
+
+from two_level import create_system
+
+SimpleOpts.add_option(
+    "--experiments",
+    type=int,
+    default=None,
+    help="Number of experiments (default: 100, or the whole fault list)",
+)
+SimpleOpts.add_option(
+    "--jobs",
+    type=int,
+    default=os.cpu_count(),
+    help="Maximum number of experiments running at the same time",
+)
+SimpleOpts.add_option(
+    "--first-clock",
+    type=int,
+    default=0,
+    help="Clock cycle at which the injection window opens",
+)
+SimpleOpts.add_option(
+    "--seed",
+    type=int,
+    default=1,
+    help="Campaign seed, experiment N can be rerun alone with seed and "
+    "experiment=N",
+)
+SimpleOpts.add_option(
+    "--first-experiment",
+    type=int,
+    default=0,
+    help="Index of the first experiment (to shard a campaign)",
+)
+
+SimpleOpts.add_option(
+    "--fault-list",
+    default="",
+    help="CSV list of faults, one experiment per fault "
+    "(injector,when,target,target2,target3,fault_type,mask)",
+)
+SimpleOpts.add_option(
+    "--checkpoint",
+    default="",
+    help="Checkpoint of the golden state at --first-clock, restored if it "
+    "exists and taken otherwise",
+)
+
+args = SimpleOpts.parse_args()
+
+
+def read_fault_list(path):
+    faults = []
+    with open(path, newline="") as f:
+        for lineno, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            if len(row) != 7 or row[0].strip() not in ("reg", "cache", "mem"):
+                sys.exit(f"{path}:{lineno}: expected injector,when,target,"
+                         "target2,target3,fault_type,mask")
+            try:
+                when, target, target2, target3 = (int(v, 0) for v in row[1:5])
+                fault = (when, target, target2, target3,
+                         parse_fault_type(row[5]), int(row[6], 0))
+            except ValueError as e:
+                sys.exit(f"{path}:{lineno}: {e}")
+            faults.append((row[0].strip(), fault))
+    return faults
+
+
+fault_list = read_fault_list(args.fault_list) if args.fault_list else None
+
+system = create_system(args, campaign_mode=True)
+injectors = [system.CHAOSReg, system.CHAOSCache, system.CHAOSMem]
+for injector in injectors:
+    injector.firstClock = args.first_clock
+    injector.seed = args.seed
+
+# The children would all write to the program output file opened by the
+# parent, so their outcome is classified on the exit code and on the
+# watchdog only (give CHAOSOutcome an output memory region to detect SDCs)
+if args.golden_outcome:
+    system.CHAOSOutcome.outputFile = ""
+
+root = Root(full_system=False, system=system)
+restore = args.checkpoint and os.path.isdir(args.checkpoint)
+m5.instantiate(args.checkpoint if restore else None)
+
+# m5.fork() refuses to fork while remote GDB listeners are active
+m5.disableAllListeners()
+
+# Golden prefix, simulated (or restored) once for the whole campaign
+prefix_ticks = args.first_clock * system.CHAOSCache.tickToClockRatio
+if not restore and prefix_ticks > 0:
+    exit_event = m5.simulate(prefix_ticks)
+    if exit_event.getCause() != "simulate() limit reached":
+        print(
+            f"Workload ended @ tick {m5.curTick()} before the injection "
+            f"window: {exit_event.getCause()}"
+        )
+        if args.golden_outcome:
+            system.CHAOSOutcome.discardRun()
+        sys.exit(1)
+    if args.checkpoint:
+        m5.checkpoint(args.checkpoint)
+
+print(f"Golden prefix done @ tick {m5.curTick()}, forking experiments")
+
+summary_path = os.path.join(m5.options.outdir, "campaign.csv")
+
+
+def run_experiment(experiment):
+    """Body of a forked child: arm the injectors and run to completion."""
+    # Stats of the child go to its own output directory
+    m5.stats.outputList.clear()
+    m5.stats.addStatVisitor("stats.txt")
+
+    if fault_list:
+        name, fault = fault_list[experiment]
+        injector = {
+            "reg": system.CHAOSReg,
+            "cache": system.CHAOSCache,
+            "mem": system.CHAOSMem,
+        }[name]
+        injector.armFault(*fault)
+    else:
+        for injector in injectors:
+            injector.startExperiment(experiment)
+
+    exit_event = m5.simulate()
+    outcome = ""
+    if args.golden_outcome:
+        outcome = system.CHAOSOutcome.classify(
+            exit_event.getCause(), exit_event.getCode()
+        )
+    m5.stats.dump()
+
+    with open(summary_path, "a") as summary:
+        summary.write(
+            f"{args.seed},{experiment},{m5.curTick()},"
+            f"{exit_event.getCode()},\"{exit_event.getCause()}\",{outcome}\n"
+        )
+
+
+def reap(pid, status):
+    """Record an experiment whose child died before writing its summary line."""
+    experiment = running.pop(pid, None)
+    if experiment is None or status == 0:
+        return
+    if os.WIFSIGNALED(status):
+        code, cause = -os.WTERMSIG(status), f"killed by signal {os.WTERMSIG(status)}"
+    else:
+        code, cause = os.WEXITSTATUS(status), "simulator exited"
+    outcome = "crash" if args.golden_outcome else ""
+    with open(summary_path, "a") as summary:
+        summary.write(f"{args.seed},{experiment},,{code},\"{cause}\",{outcome}\n")
+
+
+running = {}
+if fault_list:
+    available = len(fault_list) - args.first_experiment
+    args.experiments = min(args.experiments or available, available)
+elif args.experiments is None:
+    args.experiments = 100
+last_experiment = args.first_experiment + args.experiments
+for experiment in range(args.first_experiment, last_experiment):
+    while len(running) >= args.jobs:
+        reap(*os.wait())
+
+    pid = m5.fork(
+        os.path.join("%(parent)s", f"experiment{experiment}")
+    )
+    if pid == 0:
+        status = 0
+        try:
+            run_experiment(experiment)
+        except Exception:
+            traceback.print_exc()
+            status = 1
+        sys.stdout.flush()
+        sys.stderr.flush()
+        # Skip the parent's exit handlers, they belong to the golden run
+        os._exit(status)
+
+    running[pid] = experiment
+
+while running:
+    reap(*os.wait())
+
+# The parent only simulated the golden prefix, it has no outcome of its own
+if args.golden_outcome:
+    system.CHAOSOutcome.discardRun()
+
+print(f"Campaign done: {args.experiments} experiments, summary in {summary_path}")
@@ -70,83 +70,154 @@ print(default_binary)
 
 # Binary to execute
 SimpleOpts.add_option("binary", nargs="?", default=default_binary)
+SimpleOpts.add_option(
+    "--golden-hashes",
+    default="",
+    help="Golden state digests, the run ends as soon as a fault is masked",
+)
+SimpleOpts.add_option(
+    "--record-golden",
+    action="store_true",
+    help="Fault-free run recording the golden state digests to "
+    "--golden-hashes and the golden outcome to --golden-outcome (in the "
+    "output directory)",
+)
+SimpleOpts.add_option(
+    "--golden-outcome",
+    default="",
+    help="Golden reference of the run, used to classify the outcome "
+    "(masked, SDC, crash, hang) and to stop hung runs",
+)
 
-# Finalize the arguments and grab the args so we can pass it on to our objects
-args = SimpleOpts.parse_args()
-
-# create the system we are going to simulate
-system = System()
-
-# Set the clock frequency of the system (and all of its children)
-system.clk_domain = SrcClockDomain()
-system.clk_domain.clock = "1GHz"
-system.clk_domain.voltage_domain = VoltageDomain()
-
-# Set up the system
-system.mem_mode = "timing"  # Use timing accesses
-system.mem_ranges = [AddrRange("512MiB")]  # Create an address range
-
-# Create a simple CPU
-system.cpu = RiscvO3CPU()
-
-# Create an L1 instruction and data cache
-system.cpu.icache = L1ICache(args)
-system.cpu.dcache = L1DCache(args)
-
-# Connect the instruction and data caches to the CPU
-system.cpu.icache.connectCPU(system.cpu)
-system.cpu.dcache.connectCPU(system.cpu)
-
-# Create a memory bus, a coherent crossbar, in this case
-system.l2bus = L2XBar()
-
-# Hook the CPU ports up to the l2bus
-system.cpu.icache.connectBus(system.l2bus)
-system.cpu.dcache.connectBus(system.l2bus)
-
-# Create an L2 cache and connect it to the l2bus
-system.l2cache = L2Cache(args)
-system.l2cache.connectCPUSideBus(system.l2bus)
-
-# Create a memory bus
-system.membus = SystemXBar()
-
-# Connect the L2 cache to the membus
-system.l2cache.connectMemSideBus(system.membus)
-
-# create the interrupt controller for the CPU
-system.cpu.createInterruptController()
-
-# Connect the system up to the membus
-system.system_port = system.membus.cpu_side_ports
-
-# Create a DDR3 memory controller
-system.mem_ctrl = MemCtrl()
-system.mem_ctrl.dram = DDR3_1600_8x8()
-system.mem_ctrl.dram.range = system.mem_ranges[0]
-system.mem_ctrl.port = system.membus.mem_side_ports
-
-system.workload = SEWorkload.init_compatible(args.binary)
-
-# Create a process for a simple "Hello World" application
-process = Process()
-# Set the command
-# cmd is a list which begins with the executable (like argv)
-process.cmd = [args.binary]
-# Set the cpu to use the process as its workload and create thread contexts
-system.cpu.workload = process
-system.cpu.createThreads()
-
-# Fault injection probabilities
-system.CHAOSReg = CHAOSReg(cpu=system.cpu, probability=0.0001)
-system.CHAOSCache = CHAOSCache(target_cache = system.l2cache, probability = 0.0001)
-system.CHAOSMem = CHAOSMem(mem=system.mem_ctrl.dram, probability=0.0001)
-
-# set up the root SimObject and start the simulation
-root = Root(full_system=False, system=system)
-# instantiate all of the objects we've created above
-m5.instantiate()
 
-print(f"Beginning simulation!")
-exit_event = m5.simulate()
-print(f"Exiting @ tick {m5.curTick()} because {exit_event.getCause()}")
\ No newline at end of file
+def create_system(args, campaign_mode=False):
+    """Build the two-level system with the CHAOS injectors attached.
+    With campaign_mode, the injectors stay idle until startExperiment() is
+    called on them (see campaign.py).
+    """
+
+    # create the system we are going to simulate
+    system = System()
+
+    # Set the clock frequency of the system (and all of its children)
+    system.clk_domain = SrcClockDomain()
+    system.clk_domain.clock = "1GHz"
+    system.clk_domain.voltage_domain = VoltageDomain()
+
+    # Set up the system
+    system.mem_mode = "timing"  # Use timing accesses
+    system.mem_ranges = [AddrRange("512MiB")]  # Create an address range
+
+    # Create a simple CPU
+    system.cpu = RiscvO3CPU()
+
+    # Create an L1 instruction and data cache
+    system.cpu.icache = L1ICache(args)
+    system.cpu.dcache = L1DCache(args)
+
+    # Connect the instruction and data caches to the CPU
+    system.cpu.icache.connectCPU(system.cpu)
+    system.cpu.dcache.connectCPU(system.cpu)
+
+    # Create a memory bus, a coherent crossbar, in this case
+    system.l2bus = L2XBar()
+
+    # Hook the CPU ports up to the l2bus
+    system.cpu.icache.connectBus(system.l2bus)
+    system.cpu.dcache.connectBus(system.l2bus)
+
+    # Create an L2 cache and connect it to the l2bus
+    system.l2cache = L2Cache(args)
+    system.l2cache.connectCPUSideBus(system.l2bus)
+
+    # Create a memory bus
+    system.membus = SystemXBar()
+
+    # Connect the L2 cache to the membus
+    system.l2cache.connectMemSideBus(system.membus)
+
+    # create the interrupt controller for the CPU
+    system.cpu.createInterruptController()
+
+    # Connect the system up to the membus
+    system.system_port = system.membus.cpu_side_ports
+
+    # Create a DDR3 memory controller
+    system.mem_ctrl = MemCtrl()
+    system.mem_ctrl.dram = DDR3_1600_8x8()
+    system.mem_ctrl.dram.range = system.mem_ranges[0]
+
+    # Interpose CHAOSMem between the memory bus and the memory controller so that
+    # stuck-at faults are enforced on every access
+    system.CHAOSMem = CHAOSMem(
+        mem=system.mem_ctrl.dram, probability=0.0001, campaignMode=campaign_mode
+    )
+    system.CHAOSMem.cpu_side_port = system.membus.mem_side_ports
+    system.mem_ctrl.port = system.CHAOSMem.mem_side_port
+
+    system.workload = SEWorkload.init_compatible(args.binary)
+
+    # Create a process for a simple "Hello World" application
+    process = Process()
+    # Set the command
+    # cmd is a list which begins with the executable (like argv)
+    process.cmd = [args.binary]
+    # Set the cpu to use the process as its workload and create thread contexts
+    system.cpu.workload = process
+    system.cpu.createThreads()
+
+    # Fault injection probabilities (no faults while recording the golden run)
+    probability = 0.0 if args.record_golden else 0.0001
+    system.CHAOSMem.probability = probability
+    system.CHAOSReg = CHAOSReg(
+        cpu=system.cpu, probability=probability, campaignMode=campaign_mode
+    )
+    # One injector over the whole cache hierarchy, faults spread by capacity
+    system.CHAOSCache = CHAOSCache(
+        target_caches=[system.cpu.icache, system.cpu.dcache, system.l2cache],
+        capacityWeighted=True,
+        probability=probability,
+        campaignMode=campaign_mode,
+    )
+
+    # Compare the state with the golden run to stop masked faults early
+    if args.golden_hashes:
+        system.CHAOSConvergence = CHAOSConvergence(
+            caches=[system.cpu.dcache],
+            goldenFile=args.golden_hashes,
+            recordGolden=args.record_golden,
+        )
+
+    # Classify the run; the program output goes to a file to detect SDCs
+    if args.golden_outcome:
+        process.output = "program.out"
+        system.CHAOSOutcome = CHAOSOutcome(
+            cpus=[system.cpu],
+            goldenFile=args.golden_outcome,
+            recordGolden=args.record_golden,
+            outputFile=process.output,
+        )
+
+    return system
+
+
+if __name__ == "__m5_main__":
+    # Finalize the arguments and grab the args so we can pass it on to our
+    # objects
+    args = SimpleOpts.parse_args()
+
+    system = create_system(args)
+
+    # set up the root SimObject and start the simulation
+    root = Root(full_system=False, system=system)
+    # instantiate all of the objects we've created above
+    m5.instantiate()
+
+    print(f"Beginning simulation!")
+    exit_event = m5.simulate()
+    print(f"Exiting @ tick {m5.curTick()} because {exit_event.getCause()}")
+    if args.golden_outcome:
+        outcome = system.CHAOSOutcome.classify(
+            exit_event.getCause(), exit_event.getCode()
+        )
+        print(f"Outcome: {outcome}")
\ No newline at end of file
@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+""" Print a binary CHAOS injection log (logFormat="binary") in the text log
+format of the injector that wrote it.
+
+The file is a 24-byte header, a table of NUL-terminated strings and fixed
+32-byte records, little-endian. See CHAOSCommon/binary_log.hh.
+
+Usage:
+    decode_log.py m5out/fault_injections.bin > fault_injections.log
+"""
+
+import struct
+import sys
+
+MAGIC = b"CHAOSLG\0"
+VERSION = 2
+HEADER = struct.Struct("<8sIIII")
+RECORD = struct.Struct("<QQQIHBB")
+
+REG, CACHE, MEM, MEM_MASK, REG_ERROR, O3, DRAM, CACHE_LINE, CACHE_META = range(9)
+FAULT_TYPES = ["bit_flip", "stuck_at_zero", "stuck_at_one"]
+STRUCTURES = ["architectural", "physical_regfile", "rob", "iq", "lsq"]
+DRAM_MODELS = ["bytes", "row", "column", "bank", "rank"]
+MBU_PATTERNS = ["bytes", "adjacent", "word", "column_sets", "column_ways"]
+CACHE_FIELDS = ["data", "tag", "coherence", "replacement"]
+
+
+def read_log(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, record_size, strings_size, num_targets = \
+        HEADER.unpack_from(data)
+    if magic != MAGIC or version not in (1, VERSION) \
+            or record_size != RECORD.size:
+        sys.exit(f"{path} is not a version 1 or {VERSION} CHAOS binary log")
+    # Version 1 logs have a single target and a zero header field
+    if version == 1:
+        num_targets = 1
+    start = HEADER.size
+    strings = data[start : start + strings_size].split(b"\0")[:-1]
+    strings = [s.decode() for s in strings]
+    offset = start + strings_size
+    # A trailing partial record means the simulation was killed mid-write
+    count = (len(data) - offset) // RECORD.size
+    records = [
+        RECORD.unpack_from(data, offset + i * RECORD.size) for i in range(count)
+    ]
+    return strings[:num_targets], strings[num_targets:], records
+
+
+def reg_mask(mask, records, i):
+    """ Register mask as printed by CHAOSReg: 64 bits in binary, or the
+    bytes of a vector mask (continued in MEM_MASK records) in hex. """
+    mask_bytes = mask.to_bytes(8, "little")
+    while i < len(records) and records[i][5] == MEM_MASK:
+        mask_bytes += records[i][2].to_bytes(8, "little")
+        i += 1
+    if len(mask_bytes) == 8:
+        return f"{mask:064b}", i
+    return mask_bytes.hex(), i
+
+
+def decode(targets, classes, records, out):
+    i = 0
+    while i < len(records):
+        time, target, mask, target2, target3, kind, fault_type = records[i]
+        i += 1
+        fault = FAULT_TYPES[fault_type]
+
+        if kind in (REG, O3):
+            mask_text, i = reg_mask(mask, records, i)
+
+        if kind == REG:
+            out.write(
+                f"Cycle: {time}, CPU: {targets[target2 >> 16]}, "
+                f"Thread: {target2 & 0xffff}, "
+                f"Register: {classes[target3]}[{target}], "
+                f"FaultType: {fault}, Mask: {mask_text}\n"
+            )
+        elif kind == REG_ERROR:
+            where = f", CPU: {targets[target2 >> 16]}" if len(targets) > 1 else ""
+            out.write(
+                "Error: Exception during fault injection. "
+                f"ThreadID: {target2 & 0xffff}{where}\n"
+            )
+        elif kind == O3:
+            structure = STRUCTURES[target3]
+            field = target2 & 0xffff
+            if structure == "physical_regfile":
+                field = classes[field]
+            elif structure == "rob":
+                field = f"dest{field}"
+            elif structure == "iq":
+                field = f"src{field}"
+            else:
+                field = "address" if field else "data"
+            out.write(
+                f"Cycle: {time}, CPU: {targets[target2 >> 16]}, "
+                f"Structure: {structure}, Entry: {target}, Field: {field}, "
+                f"FaultType: {fault}, Mask: {mask_text}\n"
+            )
+        elif kind == CACHE:
+            where = f", Cache: {targets[target3]}" if len(targets) > 1 else ""
+            out.write(
+                f"Tick: {time}{where}, Cache Block Addr: {target}, "
+                f"Byte Offset: {target2}, FaultType: {fault}, "
+                f"Mask: {mask:08b}\n"
+            )
+        elif kind == MEM:
+            size = target2
+            mask_bytes = mask.to_bytes(8, "little")
+            while len(mask_bytes) < size and i < len(records) \
+                    and records[i][5] == MEM_MASK:
+                mask_bytes += records[i][2].to_bytes(8, "little")
+                i += 1
+            mask_bytes = mask_bytes[:size]
+            if size == 1:
+                line = f"Tick: {time}, target addr: {target}, Mask: {mask_bytes[0]:08b}"
+            else:
+                line = (
+                    f"Tick: {time}, target addr: {target}, Size: {size}, "
+                    f"Mask: {mask_bytes.hex()}"
+                )
+            out.write(f"{line}, Fault Type: {fault}\n")
+        elif kind == DRAM:
+            mask_bytes = mask.to_bytes(8, "little")
+            while i < len(records) and records[i][5] == MEM_MASK:
+                mask_bytes += records[i][2].to_bytes(8, "little")
+                i += 1
+            out.write(
+                f"Tick: {time}, DRAM Fault: {DRAM_MODELS[target3]}, "
+                f"Rank: {target2 >> 16}, Bank: {target2 & 0xffff}, "
+                f"Row: {target >> 32}, Column: {target & 0xffffffff}, "
+                f"Mask: {mask_bytes.hex()}, Fault Type: {fault}\n"
+            )
+        elif kind == CACHE_LINE:
+            mask_bytes = mask.to_bytes(8, "little")
+            while i < len(records) and records[i][5] == MEM_MASK:
+                mask_bytes += records[i][2].to_bytes(8, "little")
+                i += 1
+            where = f", Cache: {targets[target3]}" if len(targets) > 1 else ""
+            out.write(
+                f"Tick: {time}{where}, Cache Block Addr: {target}, "
+                f"Pattern: {MBU_PATTERNS[target2 >> 16]}, Blocks: {target2 & 0xffff}, "
+                f"FaultType: {fault}, Mask: {mask_bytes.hex()}\n"
+            )
+        elif kind == CACHE_META:
+            where = f", Cache: {targets[target3]}" if len(targets) > 1 else ""
+            out.write(
+                f"Tick: {time}{where}, Cache Block Addr: {target}, "
+                f"Field: {CACHE_FIELDS[target2]}, FaultType: {fault}, "
+                f"Mask: {mask:#x}\n"
+            )
+
+
+def main():
+    if len(sys.argv) != 2:
+        sys.exit(__doc__)
+    targets, classes, records = read_log(sys.argv[1])
+    decode(targets, classes, records, sys.stdout)
+
+
+if __name__ == "__main__":
+    main()
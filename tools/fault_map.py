@@ -0,0 +1,95 @@
+#!/usr/bin/env python3
+""" Build and inspect the binary fault maps of stuck cells loaded by
+CHAOSMem (faultMap parameter).
+
+A fault map is a 24-byte header followed by fixed-size 24-byte records,
+little-endian. Each record holds the stuck bits of the 8 bytes starting at
+its address. See CHAOSCommon/fault_overlay.hh.
+
+Input CSV columns (one stuck cell per line, '#' starts a comment):
+    address,bit,value
+
+    address = physical byte address, bit = bit in the byte (0-7),
+    value = 0 (stuck-at-0) or 1 (stuck-at-1)
+
+Cells of the same 8 bytes stuck at the same value share a record.
+Numbers may be written in decimal, hex (0x) or binary (0b).
+
+Usage:
+    fault_map.py build cells.csv map.bin
+    fault_map.py dump map.bin
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = b"CHAOSFM\0"
+VERSION = 1
+HEADER = struct.Struct("<8sIIQ")
+RECORD = struct.Struct("<QQB7x")
+
+FAULT_TYPES = ["bit_flip", "stuck_at_zero", "stuck_at_one"]
+
+
+def read_csv(path):
+    # (8-byte group, value) -> 64-bit mask
+    groups = {}
+    with open(path, newline="") as f:
+        for lineno, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            if len(row) != 3:
+                sys.exit(f"{path}:{lineno}: expected 3 columns, got {len(row)}")
+            try:
+                address, bit, value = (int(v, 0) for v in row)
+            except ValueError as e:
+                sys.exit(f"{path}:{lineno}: {e}")
+            if bit not in range(8) or value not in (0, 1):
+                sys.exit(f"{path}:{lineno}: bit must be 0-7 and value 0 or 1")
+            key = (address & ~7, value)
+            groups[key] = groups.get(key, 0) | (1 << (8 * (address & 7) + bit))
+    # Fault types 1 (stuck-at-0) and 2 (stuck-at-1), as in the schedules
+    return [(addr, mask, value + 1) for (addr, value), mask in sorted(groups.items())]
+
+
+def write_map(path, records):
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, RECORD.size, len(records)))
+        for record in records:
+            f.write(RECORD.pack(*record))
+    return len(records)
+
+
+def read_map(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, record_size, num_records = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit(f"{path} is not a version {VERSION} CHAOS fault map")
+    for i in range(num_records):
+        yield RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    build = sub.add_parser("build", help="Convert a CSV list of stuck cells to a fault map")
+    build.add_argument("csv")
+    build.add_argument("output")
+    dump = sub.add_parser("dump", help="Print a fault map as one CSV line per record")
+    dump.add_argument("map")
+    args = parser.parse_args()
+
+    if args.command == "build":
+        n = write_map(args.output, read_csv(args.csv))
+        print(f"{args.output}: {n} records")
+    else:
+        for addr, mask, fault_type in read_map(args.map):
+            print(f"{addr:#x},{FAULT_TYPES[fault_type]},{mask:#x}")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+""" Build and inspect the binary fault schedules replayed by the CHAOS
+injectors (faultSchedule parameter).
+
+A schedule is a 24-byte header followed by fixed-size 32-byte records,
+little-endian, sorted by time. See CHAOSCommon/fault_schedule.hh.
+
+Input CSV columns (one fault per line, '#' starts a comment):
+    when,target,target2,target3,fault_type,mask
+
+    CHAOSReg:   when = CPU cycle, target = register index,
+                target2 = (CPU index << 16) | thread,
+                target3 = register class index
+    CHAOSCache: when = tick, target = set,
+                target2 = (cache index << 16) | way,
+                target3 = byte offset in the block
+    CHAOSMem:   when = tick, target = physical address,
+                mask bytes cover target..target+7 (byte 0 = lowest byte)
+
+fault_type is bit_flip, stuck_at_zero or stuck_at_one (or 0, 1, 2).
+Numbers may be written in decimal, hex (0x) or binary (0b).
+
+Usage:
+    fault_schedule.py build faults.csv faults.bin
+    fault_schedule.py dump faults.bin
+"""
+
+import argparse
+import csv
+import struct
+import sys
+
+MAGIC = b"CHAOSFS\0"
+VERSION = 1
+HEADER = struct.Struct("<8sIIQ")
+RECORD = struct.Struct("<QQIHBBQ")
+
+FAULT_TYPES = ["bit_flip", "stuck_at_zero", "stuck_at_one"]
+
+
+def parse_fault_type(value):
+    value = value.strip()
+    if value in FAULT_TYPES:
+        return FAULT_TYPES.index(value)
+    index = int(value, 0)
+    if index not in range(len(FAULT_TYPES)):
+        raise ValueError(f"unknown fault type {value}")
+    return index
+
+
+def read_csv(path):
+    records = []
+    with open(path, newline="") as f:
+        for lineno, row in enumerate(csv.reader(f), 1):
+            if not row or row[0].strip().startswith("#"):
+                continue
+            if len(row) != 6:
+                sys.exit(f"{path}:{lineno}: expected 6 columns, got {len(row)}")
+            try:
+                when, target, target2, target3 = (int(v, 0) for v in row[:4])
+                fault_type = parse_fault_type(row[4])
+                mask = int(row[5], 0)
+            except ValueError as e:
+                sys.exit(f"{path}:{lineno}: {e}")
+            records.append((when, target, target2, target3, fault_type, 0, mask))
+    return records
+
+
+def write_schedule(path, records):
+    # Stable sort, faults with the same time keep the CSV order
+    records = sorted(records, key=lambda r: r[0])
+    with open(path, "wb") as f:
+        f.write(HEADER.pack(MAGIC, VERSION, RECORD.size, len(records)))
+        for record in records:
+            f.write(RECORD.pack(*record))
+    return len(records)
+
+
+def read_schedule(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    magic, version, record_size, num_records = HEADER.unpack_from(data)
+    if magic != MAGIC or version != VERSION or record_size != RECORD.size:
+        sys.exit(f"{path} is not a version {VERSION} CHAOS fault schedule")
+    for i in range(num_records):
+        yield RECORD.unpack_from(data, HEADER.size + i * RECORD.size)
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__,
+        formatter_class=argparse.RawDescriptionHelpFormatter)
+    sub = parser.add_subparsers(dest="command", required=True)
+    build = sub.add_parser("build", help="Convert a CSV fault list to a schedule")
+    build.add_argument("csv")
+    build.add_argument("output")
+    dump = sub.add_parser("dump", help="Print a schedule as CSV")
+    dump.add_argument("schedule")
+    args = parser.parse_args()
+
+    if args.command == "build":
+        n = write_schedule(args.output, read_csv(args.csv))
+        print(f"{args.output}: {n} records")
+    else:
+        for when, target, target2, target3, fault_type, _, mask in \
+                read_schedule(args.schedule):
+            print(f"{when},{target:#x},{target2},{target3},"
+                  f"{FAULT_TYPES[fault_type]},{mask:#x}")
+
+
+if __name__ == "__main__":
+    main()